@@ -83,9 +83,22 @@ public:
 
 	/**
 	 * Sets whether Unreal should send the depth buffer to the Varjo stack or not
-	 * Warning: Works only with Varjo's custom UnrealEngine
+	 * Same as the vr.Varjo.SubmitDepth console variable. On D3D11 requires Varjo's custom UnrealEngine.
 	 * @param	Enabled		True if Unreal should send the depth buffer, false otherwise
 	 */
 	UFUNCTION(BlueprintCallable, Category = "VarjoHMD")
 	static void SetDepthSubmissionEnabled(bool Enabled);
+
+	/**
+	 * Starts a dynamic resolution calibration sweep, same as the vr.Varjo.CalibrateDynamicRes console command.
+	 * Steps the context and focus view fractions over a few seconds while the current camera keeps rendering, then
+	 * writes recommended bounds and headroom to the engine config. Needs dynamic resolution enabled.
+	 * @return	True if the sweep was started
+	 */
+	UFUNCTION(BlueprintCallable, Category = "VarjoHMD")
+	static bool StartDynamicResolutionCalibration();
+
+	/** True from the start of a dynamic resolution calibration sweep until its result is written or it is cancelled */
+	UFUNCTION(BlueprintPure, Category = "VarjoHMD")
+	static bool IsDynamicResolutionCalibrating();
 };
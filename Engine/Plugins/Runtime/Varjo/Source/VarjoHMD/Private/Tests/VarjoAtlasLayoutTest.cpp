@@ -0,0 +1,107 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Math/RandomStream.h"
+#include "VarjoAtlasLayout.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVarjoAtlasLayoutSubmitViewportsTest, "Plugins.Varjo.AtlasLayout.SubmitViewports",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+namespace
+{
+	// Stands in for the runtime and the dynamic resolution controller: walks the view fractions and the focus area
+	// scale up and down in the steps they take, with the occasional jump back to full resolution.
+	struct FVarjoFrameSource
+	{
+		FRandomStream Random{ 1234 };
+		float ContextFraction = 1.0f;
+		float FocusFraction = 1.0f;
+		float FocusAreaScale = 1.0f;
+
+		void NextFrame()
+		{
+			if (Random.FRand() < 0.05f)
+			{
+				ContextFraction = FocusFraction = FocusAreaScale = 1.0f;
+				return;
+			}
+			ContextFraction = Step(ContextFraction, 0.01f, 0.5f, 1.0f);
+			// The focus fraction never drops below the context fraction, or the focus rects would move into the context rects.
+			FocusFraction = FMath::Max(Step(FocusFraction, 0.01f, 0.5f, 1.0f), ContextFraction);
+			FocusAreaScale = Step(FocusAreaScale, 0.05f, 0.6f, 1.0f);
+		}
+
+		float Step(float Value, float StepSize, float Min, float Max)
+		{
+			const int32 Steps = Random.RandRange(-3, 3);
+			return FMath::Clamp(FMath::RoundToFloat((Value + Steps * StepSize) / StepSize) * StepSize, Min, Max);
+		}
+	};
+}
+
+bool FVarjoAtlasLayoutSubmitViewportsTest::RunTest(const FString& Parameters)
+{
+	const FVarjoAtlasLayout Layout;
+	const FIntPoint AtlasSize = Layout.GetAtlasSize();
+	const int32 FrameCount = 600;
+
+	// First viewport seen for each view and set of inputs. Later frames with the same inputs must match it exactly.
+	TMap<FString, FIntRect> FirstSeen;
+	FVarjoFrameSource Source;
+	for (int32 Frame = 0; Frame < FrameCount; Frame++)
+	{
+		Source.NextFrame();
+
+		FIntRect Rects[FVarjoAtlasLayout::VIEW_COUNT];
+		for (int32 ViewIndex = 0; ViewIndex < FVarjoAtlasLayout::VIEW_COUNT; ViewIndex++)
+		{
+			const FIntRect BaseRect = Layout.GetViewRect(ViewIndex);
+			const float Fraction = ViewIndex < 2 ? Source.ContextFraction : Source.FocusFraction;
+			const FIntRect Rect = FVarjoAtlasLayout::GetSubmitViewRect(BaseRect, ViewIndex, Source.FocusAreaScale, Fraction);
+			Rects[ViewIndex] = Rect;
+
+			const FString Context = FString::Printf(TEXT("frame %d, view %d, fraction %.2f, focus area %.2f"), Frame, ViewIndex, Fraction, Source.FocusAreaScale);
+
+			// The engine renders the narrowed rect scaled with its own rounding; the viewport must cover exactly that.
+			const FIntRect EngineRect = ViewIndex > 1 ? FVarjoAtlasLayout::NarrowViewRect(BaseRect, Source.FocusAreaScale) : BaseRect;
+			TestEqual(*FString::Printf(TEXT("Width, %s"), *Context), Rect.Width(), FMath::Max(FMath::CeilToInt(EngineRect.Width() * Fraction), 1));
+			TestEqual(*FString::Printf(TEXT("Height, %s"), *Context), Rect.Height(), FMath::Max(FMath::CeilToInt(EngineRect.Height() * Fraction), 1));
+			TestTrue(*FString::Printf(TEXT("Inside atlas, %s"), *Context),
+				Rect.Min.X >= 0 && Rect.Min.Y >= 0 && Rect.Max.X <= AtlasSize.X && Rect.Max.Y <= AtlasSize.Y);
+
+			// Full resolution and full focus area give back the runtime's layout, whatever the frames before did.
+			if (Fraction == 1.0f && (ViewIndex < 2 || Source.FocusAreaScale == 1.0f))
+			{
+				TestEqual(*FString::Printf(TEXT("Base layout, %s"), *Context), Rect, BaseRect);
+			}
+
+			const FString Key = FString::Printf(TEXT("%d %.2f %.2f"), ViewIndex, Fraction, ViewIndex > 1 ? Source.FocusAreaScale : 1.0f);
+			if (const FIntRect* First = FirstSeen.Find(Key))
+			{
+				TestEqual(*FString::Printf(TEXT("No drift, %s"), *Context), Rect, *First);
+			}
+			else
+			{
+				FirstSeen.Add(Key, Rect);
+			}
+		}
+
+		// Views sample disjoint parts of the atlas.
+		for (int32 A = 0; A < FVarjoAtlasLayout::VIEW_COUNT; A++)
+		{
+			for (int32 B = A + 1; B < FVarjoAtlasLayout::VIEW_COUNT; B++)
+			{
+				const bool bOverlap = Rects[A].Min.X < Rects[B].Max.X && Rects[B].Min.X < Rects[A].Max.X
+					&& Rects[A].Min.Y < Rects[B].Max.Y && Rects[B].Min.Y < Rects[A].Max.Y;
+				TestFalse(*FString::Printf(TEXT("Views %d and %d overlap in frame %d"), A, B, Frame), bOverlap);
+			}
+		}
+	}
+
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
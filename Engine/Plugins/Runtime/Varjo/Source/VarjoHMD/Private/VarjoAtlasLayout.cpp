@@ -0,0 +1,186 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#include "VarjoAtlasLayout.h"
+#include "VarjoHMD_Types.h"
+#include "RHI.h"
+
+static TAutoConsoleVariable<float> CVarVarjoContextViewScale(
+	TEXT("vr.Varjo.ContextViewScale"),
+	1.0f,
+	TEXT("Resolution scale of the context views relative to the runtime default, in range [0.25, 1].\n")
+	TEXT("Values below 1 render the context views at lower density and pack them into a smaller atlas.\n")
+	TEXT("Applied when the Varjo session starts."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVarjoSwapChainImages(
+	TEXT("vr.Varjo.SwapChainImages"),
+	0,
+	TEXT("Number of images in the Varjo color and depth swap chains.\n")
+	TEXT("0: runtime default (default)\n")
+	TEXT("2: low latency, double buffered. Saves one color and one depth image of GPU memory.\n")
+	TEXT("3: throughput, triple buffered. Also lets the game thread run one frame ahead of rendering.\n")
+	TEXT("Applied when the Varjo session starts."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVarjoSwapChainFormat(
+	TEXT("vr.Varjo.SwapChainFormat"),
+	0,
+	TEXT("Format of the Varjo color swap chain and the engine targets rendered into it.\n")
+	TEXT("0: BGRA 8-bit sRGB (default)\n")
+	TEXT("1: RGBA 8-bit sRGB\n")
+	TEXT("Applied when the Varjo session starts."),
+	ECVF_Default);
+
+FVarjoAtlasLayout::FVarjoAtlasLayout()
+{
+	SetDefaults();
+}
+
+void FVarjoAtlasLayout::Init(varjo_Session* session)
+{
+	SetDefaults();
+
+	if (session == nullptr)
+	{
+		return;
+	}
+
+	varjo_SwapChainConfig defaultScc = varjo_GetDefaultSwapChainConfig(session);
+	varjo_LayoutDefaultViewports(session, m_viewports);
+	m_numberOfTextures = defaultScc.numberOfTextures;
+
+	const int32 swapChainImages = CVarVarjoSwapChainImages.GetValueOnAnyThread();
+	if (swapChainImages > 0)
+	{
+		m_numberOfTextures = FMath::Clamp(swapChainImages, 2, 3);
+		m_throughputBuffering = m_numberOfTextures >= 3;
+	}
+
+	switch (CVarVarjoSwapChainFormat.GetValueOnAnyThread())
+	{
+	case 1:
+		m_colorFormat = varjo_TextureFormat_R8G8B8A8_SRGB;
+		m_colorPixelFormat = PF_R8G8B8A8;
+		break;
+	default:
+		break;
+	}
+
+	const float contextScale = FMath::Clamp(CVarVarjoContextViewScale.GetValueOnAnyThread(), 0.25f, 1.0f);
+	if (contextScale < 1.0f)
+	{
+		PackWithContextScale(contextScale);
+	}
+
+	UpdateAtlasSize();
+	if (m_atlasSize.X <= 0 || m_atlasSize.Y <= 0)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Runtime returned an empty viewport layout, using default %dx%d atlas."), defaultScc.textureWidth, defaultScc.textureHeight);
+		SetDefaults();
+		return;
+	}
+
+	UE_LOG(LogVarjoHMD, Log, TEXT("Stereo atlas %dx%d (swap chain default %dx%d)."), m_atlasSize.X, m_atlasSize.Y, defaultScc.textureWidth, defaultScc.textureHeight);
+	// The depth swap chain is only allocated while depth is submitted; the bridge logs its size when it creates it.
+	UE_LOG(LogVarjoHMD, Log, TEXT("Swap chains use %d images: %.1f MB color (runtime default %d images)."),
+		m_numberOfTextures, GetSwapChainMemoryMB(GPixelFormats[m_colorPixelFormat].BlockBytes), defaultScc.numberOfTextures);
+}
+
+float FVarjoAtlasLayout::GetSwapChainMemoryMB(int32 bytesPerPixel) const
+{
+	return float((double)m_atlasSize.X * m_atlasSize.Y * bytesPerPixel * m_numberOfTextures / (1024.0 * 1024.0));
+}
+
+FIntRect FVarjoAtlasLayout::GetViewRect(int32 viewIndex) const
+{
+	const varjo_Viewport& viewport = GetViewport(viewIndex);
+	return FIntRect(viewport.x, viewport.y, viewport.x + viewport.width, viewport.y + viewport.height);
+}
+
+FIntRect FVarjoAtlasLayout::ScaleViewRect(const FIntRect& viewRect, float resolutionFraction)
+{
+	if (resolutionFraction == 1.0f)
+	{
+		return viewRect;
+	}
+
+	const int32 quantization = 4;
+	const FIntPoint min(
+		FMath::DivideAndRoundUp(FMath::CeilToInt(viewRect.Min.X * resolutionFraction), quantization) * quantization,
+		FMath::DivideAndRoundUp(FMath::CeilToInt(viewRect.Min.Y * resolutionFraction), quantization) * quantization);
+	const FIntPoint size(
+		FMath::Max(FMath::CeilToInt(viewRect.Width() * resolutionFraction), 1),
+		FMath::Max(FMath::CeilToInt(viewRect.Height() * resolutionFraction), 1));
+	return FIntRect(min, min + size);
+}
+
+FIntRect FVarjoAtlasLayout::NarrowViewRect(const FIntRect& viewRect, float areaScale)
+{
+	if (areaScale >= 1.0f)
+	{
+		return viewRect;
+	}
+
+	const FIntPoint size(
+		FMath::Max(FMath::RoundToInt(viewRect.Width() * areaScale), 1),
+		FMath::Max(FMath::RoundToInt(viewRect.Height() * areaScale), 1));
+	return FIntRect(viewRect.Min, viewRect.Min + size);
+}
+
+FIntRect FVarjoAtlasLayout::GetSubmitViewRect(const FIntRect& viewRect, int32 viewIndex, float focusAreaScale, float resolutionFraction)
+{
+	const FIntRect narrowedRect = viewIndex > 1 ? NarrowViewRect(viewRect, focusAreaScale) : viewRect;
+	return ScaleViewRect(narrowedRect, resolutionFraction);
+}
+
+const varjo_Viewport& FVarjoAtlasLayout::GetViewport(int32 viewIndex) const
+{
+	check(0 <= viewIndex && viewIndex < VIEW_COUNT);
+	return m_viewports[viewIndex];
+}
+
+void FVarjoAtlasLayout::SetDefaults()
+{
+	// Layout of the 4096x3200 atlas used by the runtime when it cannot be queried.
+	m_viewports[0] = varjo_Viewport{ 0, 0, 2048, 2048 };
+	m_viewports[1] = varjo_Viewport{ 2048, 0, 2048, 2048 };
+	m_viewports[2] = varjo_Viewport{ 0, 2048, 2048, 1152 };
+	m_viewports[3] = varjo_Viewport{ 2048, 2048, 2048, 1152 };
+	m_numberOfTextures = 3;
+	m_throughputBuffering = false;
+	m_colorFormat = varjo_TextureFormat_B8G8R8A8_SRGB;
+	m_colorPixelFormat = PF_B8G8R8A8;
+	UpdateAtlasSize();
+}
+
+void FVarjoAtlasLayout::PackWithContextScale(float contextScale)
+{
+	// Context views on the first row, focus views below them. Focus views keep their full size.
+	for (int32 i = 0; i < 2; i++)
+	{
+		m_viewports[i].width = FMath::Max(1, FMath::RoundToInt(m_viewports[i].width * contextScale));
+		m_viewports[i].height = FMath::Max(1, FMath::RoundToInt(m_viewports[i].height * contextScale));
+	}
+
+	m_viewports[0].x = 0;
+	m_viewports[0].y = 0;
+	m_viewports[1].x = m_viewports[0].width;
+	m_viewports[1].y = 0;
+
+	const int32 focusY = FMath::Max(m_viewports[0].height, m_viewports[1].height);
+	m_viewports[2].x = 0;
+	m_viewports[2].y = focusY;
+	m_viewports[3].x = m_viewports[2].width;
+	m_viewports[3].y = focusY;
+}
+
+void FVarjoAtlasLayout::UpdateAtlasSize()
+{
+	// Tightly fit the atlas around the viewports.
+	m_atlasSize = FIntPoint::ZeroValue;
+	for (int32 i = 0; i < VIEW_COUNT; i++)
+	{
+		m_atlasSize.X = FMath::Max(m_atlasSize.X, m_viewports[i].x + m_viewports[i].width);
+		m_atlasSize.Y = FMath::Max(m_atlasSize.Y, m_viewports[i].y + m_viewports[i].height);
+	}
+}
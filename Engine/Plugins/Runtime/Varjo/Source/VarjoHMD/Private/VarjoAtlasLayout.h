@@ -0,0 +1,59 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PixelFormat.h"
+
+// Varjo API
+#include "Varjo.h"
+#include "Varjo_layers.h"
+
+/**
+ * Placement of the four Varjo views (left/right context, left/right focus) inside the shared stereo render target.
+ * Built once per session from the runtime's default swap chain config and viewport layout, and used for render
+ * target allocation, view rects and submitted viewports.
+ */
+class FVarjoAtlasLayout
+{
+public:
+	static const int32 VIEW_COUNT = 4;
+
+	FVarjoAtlasLayout();
+
+	void Init(varjo_Session* session);
+
+	FIntPoint GetAtlasSize() const { return m_atlasSize; }
+	FIntRect GetViewRect(int32 viewIndex) const;
+	// View rect the engine renders when the view is drawn at the given resolution fraction.
+	FIntRect GetScaledViewRect(int32 viewIndex, float resolutionFraction) const { return ScaleViewRect(GetViewRect(viewIndex), resolutionFraction); }
+	// Scales a full-resolution view rect with the renderer's rounding: sizes rounded up, origins rounded up to a
+	// multiple of 4. Submitted viewports must use the same rounding to sample exactly the rendered pixels.
+	static FIntRect ScaleViewRect(const FIntRect& viewRect, float resolutionFraction);
+	// Rect of a focus view whose angular extent is narrowed by areaScale at unchanged pixel density. Keeps the origin.
+	static FIntRect NarrowViewRect(const FIntRect& viewRect, float areaScale);
+	// Viewport submitted for a frame: the full-resolution view rect, narrowed for focus views, then scaled. Always
+	// derived from the full-resolution rect, so nothing carries over from one frame to the next.
+	static FIntRect GetSubmitViewRect(const FIntRect& viewRect, int32 viewIndex, float focusAreaScale, float resolutionFraction);
+	const varjo_Viewport& GetViewport(int32 viewIndex) const;
+	int32 GetNumberOfTextures() const { return m_numberOfTextures; }
+	// True when triple buffering was chosen explicitly, so frame pacing may queue one more frame.
+	bool IsThroughputBuffering() const { return m_throughputBuffering; }
+	// Color swap chain format and the matching format of the engine targets rendered into it.
+	varjo_TextureFormat GetColorFormat() const { return m_colorFormat; }
+	EPixelFormat GetColorPixelFormat() const { return m_colorPixelFormat; }
+	// Memory taken by one swap chain of the atlas size with the given pixel size.
+	float GetSwapChainMemoryMB(int32 bytesPerPixel) const;
+
+private:
+	void SetDefaults();
+	void PackWithContextScale(float contextScale);
+	void UpdateAtlasSize();
+
+	varjo_Viewport m_viewports[VIEW_COUNT];
+	FIntPoint m_atlasSize;
+	int32 m_numberOfTextures;
+	bool m_throughputBuffering;
+	varjo_TextureFormat m_colorFormat;
+	EPixelFormat m_colorPixelFormat;
+};
@@ -8,13 +8,25 @@
 #include "HAL/Runnable.h"
 #include "HAL/RunnableThread.h"
 
+static TAutoConsoleVariable<int32> CVarVarjoDepthFormat(
+	TEXT("vr.Varjo.DepthFormat"),
+	0,
+	TEXT("Format of the submitted depth swap chain.\n")
+	TEXT("0: match the engine depth-stencil format, scene depth renders directly into the swap chain (default)\n")
+	TEXT("1: 16-bit depth, converted from scene depth by a copy pass. Halves depth memory and compositor bandwidth.\n")
+	TEXT("Applied when the Varjo session starts."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarVarjoDepthReleaseDelay(
+	TEXT("vr.Varjo.DepthReleaseDelay"),
+	5.0f,
+	TEXT("Seconds after depth submission is turned off before the depth swap chain is released."),
+	ECVF_Default);
+
 VarjoCustomPresent::VarjoCustomPresent(FVarjoHMD* varjoHMD)
 	: m_session(varjoHMD->m_session)
-	, m_graphicsInfo(nullptr)
-	, m_submitInfo(nullptr)
 	, m_swapChain(nullptr)
 	, m_depthSwapChain(nullptr)
-	, m_texture(nullptr)
 	, m_frameInfo(nullptr)
 	, m_event(nullptr)
 	, m_varjoHMD(varjoHMD)
@@ -34,8 +46,18 @@ void VarjoCustomPresent::Init()
 		return;
 	}
 
+	m_depthCopy = CVarVarjoDepthFormat.GetValueOnGameThread() == 1;
+
 	ExecuteOnRenderThread([this]() {
 		varjoInit();
+		// Backends create the frame info last, once their swap chains exist. Without it the bridge stays
+		// uninitialized, so no frame is begun or submitted.
+		if (m_frameInfo == nullptr)
+		{
+			UE_LOG(LogHMD, Warning, TEXT("Varjo render bridge could not be initialized."));
+			m_session = nullptr;
+			return;
+		}
 		setupOcclusionMeshes();
 		m_event = varjo_AllocateEvent();
 		});
@@ -90,34 +112,162 @@ bool VarjoCustomPresent::Present(int& InOutSyncInterval)
 	check(IsInRenderingThread() || IsInRHIThread());
 	if (isInitialized()) varjoSubmit();
 
-	InOutSyncInterval = 0; // VSync off
+	// While suspended the window shows the desktop view with the project's own sync interval.
+	if (!m_suspended)
+	{
+		InOutSyncInterval = 0; // VSync off
+	}
 	return true;
 }
 
 DECLARE_CYCLE_STAT(TEXT("Varjo WaitSync"), STAT_VarjoCustomPresent_WaitSync, STATGROUP_Varjo);
 
-void VarjoCustomPresent::BeginRendering()
+void VarjoCustomPresent::BeginRendering(FRHITexture2D* RenderTarget, int32_t viewCount, float contextFraction, float focusFraction, float focusAreaScale)
+{
+	check(IsInRenderingThread());
+	if (m_suspended)
+	{
+		return;
+	}
+
+	WaitSync();
+
+	// The frame is submitted from Present on the RHI thread, possibly after the next WaitSync has overwritten the
+	// frame info, so keep what the submission needs.
+	FSubmitFrame frame;
+	if (isInitialized())
+	{
+		frame.frameNumber = m_frameInfo->frameNumber;
+		for (int32_t i = 0; i < VIEW_COUNT; i++)
+		{
+			memcpy(frame.projections[i], m_frameInfo->views[i].projectionMatrix, 16 * sizeof(double));
+			memcpy(frame.viewMatrices[i], m_frameInfo->views[i].viewMatrix, 16 * sizeof(double));
+		}
+	}
+
+	// Multisampled targets are resolved into whichever image gets acquired, through m_acquiredTexture.
+	m_msaaTarget = m_numSamples > 1 ? RenderTarget : nullptr;
+	m_frameSubmitsDepth = m_submitDepth && m_numSamples == 1 && m_depthTargetUsesSwapChain;
+	frame.submitDepth = m_frameSubmitsDepth;
+	frame.viewCount = viewCount < VIEW_COUNT ? 2 : VIEW_COUNT;
+	frame.contextFraction = contextFraction;
+	frame.focusFraction = focusFraction;
+	frame.focusAreaScale = FMath::Clamp(focusAreaScale, 0.1f, 1.0f);
+	m_renderFrame = frame;
+
+	// Images of the previous frame are released in Present, once its command lists have been submitted. Begin the
+	// frame and acquire its images in order with that instead of here, ahead of the RHI thread.
+	FTexture2DRHIRef renderTarget = RenderTarget;
+	FRHICommandListExecutor::GetImmediateCommandList().EnqueueLambda([this, renderTarget, frame](FRHICommandListImmediate&)
+	{
+		beginFrame(renderTarget, frame);
+	});
+}
+
+void VarjoCustomPresent::beginFrame(FRHITexture2D* RenderTarget, const FSubmitFrame& frame)
 {
+	// The engine did not present the previous frame, e.g. while the window was minimized.
 	if (m_inFrame)
 	{
 		int SyncInterval = 0;
 		Present(SyncInterval);
 	}
-	WaitSync();
+
+	// A backend could not submit the previous frame yet and still holds its images. Render this frame into them
+	// and submit it in their place.
+	if (m_inFrame)
+	{
+		m_submitFrame = frame;
+		aliasAcquiredImages(RenderTarget);
+		return;
+	}
+
+	m_submitFrame = frame;
 	m_inFrame = true;
+
+	// Backends that copy at submit acquire their images there.
+	m_depthSCAcquired = false;
+	if (!rendersIntoSwapChain())
+	{
+		return;
+	}
+	// Headless bridges and bridges whose swap chain could not be created end their frames without layers.
+	if (m_swapChain == nullptr)
+	{
+		return;
+	}
+
+	varjo_AcquireSwapChainImage(m_swapChain, &m_colorIndex);
+	m_depthIndex = -1;
+	if (frame.submitDepth && m_depthSwapChain != nullptr)
+	{
+		varjo_AcquireSwapChainImage(m_depthSwapChain, &m_depthIndex);
+		m_depthSCAcquired = true;
+	}
+	aliasAcquiredImages(RenderTarget);
+}
+
+void VarjoCustomPresent::aliasAcquiredImages(FRHITexture2D* RenderTarget)
+{
+	// The engine rotates its buffered targets in the same order as the swap chain, so the target it renders
+	// into normally is the acquired image already. Alias only if the two got out of step.
+	if (0 <= m_colorIndex && m_colorIndex < m_imageTextures.Num())
+	{
+		AliasTextureResources(m_acquiredTexture, m_imageTextures[m_colorIndex]);
+		if (m_numSamples == 1 && RenderTarget != nullptr && RenderTarget->GetNativeResource() != m_imageTextures[m_colorIndex]->GetNativeResource())
+		{
+			UE_LOG(LogHMD, Verbose, TEXT("Engine render target out of step with swap chain image %d, aliasing."), m_colorIndex);
+			AliasTextureResources(RenderTarget, m_imageTextures[m_colorIndex]);
+		}
+	}
+
+	// Scene depth is a single engine target, so point it at the acquired depth image.
+	if (m_depthSCAcquired && 0 <= m_depthIndex && m_depthIndex < m_depthTextures.Num())
+	{
+		AliasTextureResources(m_acquiredDepthTexture, m_depthTextures[m_depthIndex]);
+		if (!m_depthCopy)
+		{
+			AliasTextureResources(m_depthTexture, m_depthTextures[m_depthIndex]);
+		}
+	}
+}
+
+void VarjoCustomPresent::varjoSubmit()
+{
+	if (!m_inFrame)
+	{
+		return;
+	}
+
+	if (m_swapChain != nullptr)
+	{
+		varjo_ReleaseSwapChainImage(m_swapChain);
+	}
+	varjoEndFrame(releaseDepthImage());
+}
+
+bool VarjoCustomPresent::releaseDepthImage()
+{
+	const bool submitDepth = m_depthSCAcquired;
+	if (m_depthSCAcquired)
+	{
+		varjo_ReleaseSwapChainImage(m_depthSwapChain);
+		m_depthSCAcquired = false;
+	}
+	return submitDepth;
 }
 
 void VarjoCustomPresent::WaitSync()
 {
 	{
 		SCOPE_CYCLE_COUNTER(STAT_VarjoCustomPresent_WaitSync);
-		varjo_WaitSync(m_session, m_frameInfo);
-
 		if (isInitialized())
 		{
+			varjo_WaitSync(m_session, m_frameInfo);
 			varjo_Error error = varjo_GetError(m_session);
 			UE_CLOG(error != varjo_NoError, LogHMD, Log, TEXT("%s"), TEXT("varjo_Sync failed."));
 			UE_CLOG(error != varjo_NoError, LogHMD, Verbose, TEXT("%s"), ANSI_TO_TCHAR(varjo_GetErrorDesc(error)));
+			updateFramePeriod();
 		}
 	}
 
@@ -176,6 +326,311 @@ void VarjoCustomPresent::WaitSync()
 	m_varjoHMD->SetProjections(projections);
 }
 
+void VarjoCustomPresent::updateFramePeriod()
+{
+	const varjo_Nanoseconds displayTime = m_frameInfo->displayTime;
+	if (m_lastDisplayTime > 0 && displayTime > m_lastDisplayTime)
+	{
+		// Missed frames show up as multiples of the period; leave them out of the average.
+		const float periodMs = float(double(displayTime - m_lastDisplayTime) / 1.0e6);
+		if (m_framePeriodMs <= 0.0f)
+		{
+			m_framePeriodMs = periodMs;
+		}
+		else if (periodMs < m_framePeriodMs * 1.5f)
+		{
+			m_framePeriodMs = FMath::Lerp(m_framePeriodMs, periodMs, 0.05f);
+		}
+	}
+	m_lastDisplayTime = displayTime;
+}
+
+void VarjoCustomPresent::initViewports()
+{
+	for (int32_t i = 0; i < VIEW_COUNT; i++)
+	{
+		m_viewports[i] = m_varjoHMD->GetAtlasLayout().GetViewport(i);
+	}
+}
+
+varjo_TextureFormat VarjoCustomPresent::getDepthSwapChainFormat() const
+{
+	if (m_depthCopy)
+	{
+		return varjo_DepthTextureFormat_D16_UNORM;
+	}
+
+	// Match the engine's depth-stencil layout so scene depth can be rendered or copied straight into the swap chain.
+	return getEngineDepthFormat();
+}
+
+int32 VarjoCustomPresent::getDepthBytesPerPixel(varjo_TextureFormat format)
+{
+	switch (format)
+	{
+	case varjo_DepthTextureFormat_D16_UNORM:
+		return 2;
+	case varjo_DepthTextureFormat_D24_UNORM_S8_UINT:
+		return 4;
+	default:
+		// D32_FLOAT_S8_UINT is stored as 32-bit depth with a 32-bit padded stencil.
+		return 8;
+	}
+}
+
+void VarjoCustomPresent::setDepthMapping(varjo_ViewExtensionDepth& depthView) const
+{
+	// Scene depth is reversed with an infinite far plane: 1 at the near plane, 0 at infinity. The copy pass
+	// writes the same values, so UNORM formats only change the precision, not the mapping.
+	depthView.minDepth = 0.0f;
+	depthView.maxDepth = 1.0f;
+	depthView.nearZ = std::numeric_limits<float>::infinity();
+	depthView.farZ = GNearClippingPlane / m_varjoHMD->GetWorldToMetersScale();
+}
+
+void VarjoCustomPresent::SetDepthSubmissionEnabled(bool enabled)
+{
+	check(IsInRenderingThread());
+	if (m_submitDepth && !enabled)
+	{
+		m_depthDisabledTime = FPlatformTime::Seconds();
+	}
+	m_submitDepth = enabled;
+}
+
+bool VarjoCustomPresent::wantsDepthSwapChain() const
+{
+	if (m_numSamples > 1)
+	{
+		return false;
+	}
+	if (m_submitDepth)
+	{
+		return true;
+	}
+	return m_depthTargetUsesSwapChain && FPlatformTime::Seconds() - m_depthDisabledTime < CVarVarjoDepthReleaseDelay.GetValueOnAnyThread();
+}
+
+bool VarjoCustomPresent::NeedReAllocateDepthTexture(FRHITexture* DepthTarget) const
+{
+	// Only targets handed out by the bridge are switched between the swap chain and a plain target.
+	return DepthTarget != nullptr && DepthTarget == m_depthTexture.GetReference() && wantsDepthSwapChain() != m_depthTargetUsesSwapChain;
+}
+
+bool VarjoCustomPresent::createDepthPipeline()
+{
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	const FIntPoint atlasSize = layout.GetAtlasSize();
+
+	varjo_SwapChainConfig2 depthScConfig{ getDepthSwapChainFormat(), layout.GetNumberOfTextures(), atlasSize.X, atlasSize.Y, 1 };
+	m_depthSwapChain = createDepthSwapChain(depthScConfig);
+	if (m_depthSwapChain == nullptr)
+	{
+		return false;
+	}
+
+	const EPixelFormat imageFormat = m_depthCopy ? PF_ShadowDepth : PF_DepthStencil;
+	m_depthTextures.Reset(layout.GetNumberOfTextures());
+	for (int32_t i = 0; i < layout.GetNumberOfTextures(); i++)
+	{
+		FTexture2DRHIRef imageTexture = createDepthImageTexture(i, imageFormat);
+		if (imageTexture.IsValid())
+		{
+			m_depthTextures.Add(imageTexture);
+		}
+	}
+	if (m_depthTextures.Num() > 0)
+	{
+		m_acquiredDepthTexture = createDepthImageTexture(0, imageFormat);
+	}
+
+	UE_LOG(LogHMD, Log, TEXT("Depth swap chain created: %d images, %.1f MB."), layout.GetNumberOfTextures(),
+		layout.GetSwapChainMemoryMB(getDepthBytesPerPixel(depthScConfig.textureFormat)));
+	return true;
+}
+
+void VarjoCustomPresent::releaseDepthPipeline()
+{
+	m_depthTextures.Empty();
+	m_acquiredDepthTexture.SafeRelease();
+	if (m_depthSwapChain != nullptr)
+	{
+		varjo_FreeSwapChain(m_depthSwapChain);
+		m_depthSwapChain = nullptr;
+		UE_LOG(LogHMD, Log, TEXT("Depth swap chain released."));
+	}
+}
+
+bool VarjoCustomPresent::CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture)
+{
+	bool useSwapChain = wantsDepthSwapChain();
+	if (useSwapChain && m_depthSwapChain == nullptr && !createDepthPipeline())
+	{
+		UE_LOG(LogHMD, Log, TEXT("Depth swap chain could not be created, depth submission disabled."));
+		useSwapChain = false;
+	}
+	if (!useSwapChain && m_depthSwapChain != nullptr)
+	{
+		releaseDepthPipeline();
+	}
+
+	// Scene depth renders directly into the depth swap chain: the engine gets one texture that is aliased to
+	// the acquired depth image every frame, so submission needs no copy. Otherwise scene depth is a plain
+	// target, converted or copied into the acquired image when depth is submitted.
+	m_depthTexture.SafeRelease();
+	if (useSwapChain && !m_depthCopy && m_depthTextures.Num() > 0)
+	{
+		m_depthTexture = createDepthImageTexture(0, PF_DepthStencil);
+	}
+	if (!m_depthTexture.IsValid())
+	{
+		const FIntPoint atlasSize = m_varjoHMD->GetAtlasLayout().GetAtlasSize();
+		FRHIResourceCreateInfo CreateInfo;
+		CreateInfo.ClearValueBinding = FClearValueBinding::DepthFar;
+		FTexture2DRHIRef shaderResourceTexture;
+		RHICreateTargetableShaderResource2D(atlasSize.X, atlasSize.Y, PF_DepthStencil, 1, TexCreate_None, TexCreate_DepthStencilTargetable, false, CreateInfo, m_depthTexture, shaderResourceTexture);
+	}
+	m_depthTargetUsesSwapChain = useSwapChain;
+
+	OutTargetableTexture = OutShaderResourceTexture = m_depthTexture;
+	return true;
+}
+
+bool VarjoCustomPresent::CreateRenderTargetTexture(uint32 Index, uint32 NumSamples, FTexture2DRHIRef& OutTargetableTexture,
+	FTexture2DRHIRef& OutShaderResourceTexture)
+{
+	if (m_swapChain == nullptr || m_textureCount == 0)
+	{
+		return false;
+	}
+
+	// Wrap the swap chain images once; reallocations hand out the same targets again.
+	if (m_textures.Num() != m_textureCount)
+	{
+		m_textures.Reset(m_textureCount);
+		m_imageTextures.Reset(m_textureCount);
+		for (uint32_t i = 0; i < m_textureCount; i++)
+		{
+			m_textures.Add(createColorImageTexture(i));
+			m_imageTextures.Add(createColorImageTexture(i));
+		}
+		m_acquiredTexture = createColorImageTexture(0);
+	}
+
+	OutTargetableTexture = OutShaderResourceTexture = m_textures[Index % m_textureCount];
+
+	// Render multisampled, resolve straight into the swap chain image.
+	m_numSamples = FMath::Max(NumSamples, 1u);
+	if (m_numSamples > 1)
+	{
+		m_msaaTextures.SetNum(m_textureCount);
+		FTexture2DRHIRef& msaaTexture = m_msaaTextures[Index % m_textureCount];
+		if (!msaaTexture.IsValid() || msaaTexture->GetNumSamples() != m_numSamples)
+		{
+			msaaTexture = createMsaaTarget(m_numSamples);
+		}
+		OutTargetableTexture = msaaTexture;
+	}
+	return true;
+}
+
+FTexture2DRHIRef VarjoCustomPresent::createMsaaTarget(uint32 numSamples) const
+{
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	FRHIResourceCreateInfo CreateInfo;
+	CreateInfo.ClearValueBinding = FClearValueBinding::Black;
+	return RHICreateTexture2D(layout.GetAtlasSize().X, layout.GetAtlasSize().Y, layout.GetColorPixelFormat(), 1, numSamples, TexCreate_RenderTargetable, CreateInfo);
+}
+
+void VarjoCustomPresent::resolveMsaaTarget(FRHICommandListImmediate& RHICmdList, FRHITexture2D* resolveTarget)
+{
+	if (m_msaaTarget.IsValid() && resolveTarget != nullptr)
+	{
+		RHICmdList.CopyToResolveTarget(m_msaaTarget, resolveTarget, FResolveParams());
+	}
+	m_msaaTarget.SafeRelease();
+}
+
+void VarjoCustomPresent::varjoEndFrame(bool submitDepth)
+{
+	// Check that all OK
+	varjo_Error error = varjo_GetError(m_session);
+	if (error != varjo_NoError)
+	{
+		UE_LOG(LogHMD, Log, TEXT("Error existed before varjoSubmit. Skip submit. Error code: %d."), error);
+		return;
+	}
+
+	if (m_inFrame)
+	{
+		varjo_LayerMultiProj layer;
+		layer.header.type = varjo_LayerMultiProjType;
+		layer.header.flag = varjo_LayerFlagNone;
+		layer.space = varjo_SpaceLocal;
+		// Without focus views the layer carries only the context views, and the compositor shows context everywhere.
+		layer.viewCount = m_submitFrame.viewCount;
+		varjo_LayerMultiProjView views[VIEW_COUNT]{};
+		varjo_ViewExtensionDepth depthViews[VIEW_COUNT]{};
+		for (int i = 0; i < m_submitFrame.viewCount; i++)
+		{
+			memcpy(views[i].projection.value, m_submitFrame.projections[i], 16 * sizeof(double));
+			memcpy(views[i].view.value, m_submitFrame.viewMatrices[i], 16 * sizeof(double));
+			views[i].viewport.swapChain = m_swapChain;
+			// Recomputed from the full-resolution layout every frame.
+			const FIntRect viewRect(m_viewports[i].x, m_viewports[i].y, m_viewports[i].x + m_viewports[i].width, m_viewports[i].y + m_viewports[i].height);
+			const float focusAreaScale = m_submitFrame.focusAreaScale;
+			if (i > 1 && focusAreaScale < 1.0f)
+			{
+				// Same narrowing as the engine's focus projection in FVarjoHMD::GetStereoProjectionMatrix.
+				double* projection = views[i].projection.value;
+				projection[0] /= focusAreaScale;
+				projection[5] /= focusAreaScale;
+				projection[8] /= focusAreaScale;
+				projection[9] /= focusAreaScale;
+			}
+			const FIntRect scaledRect = FVarjoAtlasLayout::GetSubmitViewRect(viewRect, i, focusAreaScale, m_submitFrame.getResolutionFraction(i));
+			views[i].viewport.x = scaledRect.Min.X;
+			views[i].viewport.y = scaledRect.Min.Y;
+			views[i].viewport.width = scaledRect.Width();
+			views[i].viewport.height = scaledRect.Height();
+			views[i].viewport.arrayIndex = 0;
+			views[i].extension = submitDepth ? (varjo_ViewExtension*)& depthViews[i] : nullptr;
+
+			if (submitDepth)
+			{
+				depthViews[i].header.type = varjo_ViewExtensionDepthType;
+				depthViews[i].header.next = nullptr;
+				setDepthMapping(depthViews[i]);
+				depthViews[i].viewport.swapChain = m_depthSwapChain;
+				depthViews[i].viewport.x = views[i].viewport.x;
+				depthViews[i].viewport.y = views[i].viewport.y;
+				depthViews[i].viewport.width = views[i].viewport.width;
+				depthViews[i].viewport.height = views[i].viewport.height;
+				depthViews[i].viewport.arrayIndex = 0;
+			}
+		}
+		layer.views = &views[0];
+		varjo_LayerHeader* layerPtrs[1]{ &layer.header };
+
+		varjo_SubmitInfoLayers submitInfoLayers;
+		submitInfoLayers.flags = varjo_SubmitFlag_Async;
+		submitInfoLayers.frameNumber = m_submitFrame.frameNumber;
+		// Headless bridges have no swap chain; an empty frame still keeps the runtime's frame pacing.
+		submitInfoLayers.layerCount = m_swapChain != nullptr ? 1 : 0;
+		submitInfoLayers.layers = layerPtrs;
+
+		varjo_EndFrameWithLayers(m_session, &submitInfoLayers);
+		m_inFrame = false;
+	}
+
+	error = varjo_GetError(m_session);
+	if (error != varjo_NoError)
+	{
+		UE_LOG(LogHMD, Log, TEXT("varjoSubmit failed, error code: %d."), error);
+		return;
+	}
+}
+
 void VarjoCustomPresent::setupOcclusionMeshes()
 {
 	for (int i = 0; i < 4; ++i)
@@ -199,6 +654,11 @@ void VarjoCustomPresent::setupOcclusionMeshes()
 void VarjoCustomPresent::renderOcclusionMesh(FRHICommandList& RHICmdList, int viewIndex)
 {
 	check(IsInRenderingThread());
+	// The runtime's focus meshes cover the full focus frustum.
+	if (viewIndex > 1 && m_renderFrame.focusAreaScale < 1.0f)
+	{
+		return;
+	}
 	const FHMDViewMesh& Mesh = m_occlusionMeshes[viewIndex];
 	if (!Mesh.IsValid()) return;
 	RHICmdList.SetStreamSource(0, Mesh.VertexBufferRHI, 0);
@@ -207,6 +667,28 @@ void VarjoCustomPresent::renderOcclusionMesh(FRHICommandList& RHICmdList, int vi
 
 void VarjoCustomPresent::FinishRendering(FRHICommandListImmediate& RHICmdList)
 {
+	if (!rendersIntoSwapChain() || !m_acquiredTexture.IsValid())
+	{
+		return;
+	}
+
+	// The acquired images are only known on the RHI thread; these commands reach them through the textures aliased there.
+	if (m_numSamples > 1)
+	{
+		resolveMsaaTarget(RHICmdList, m_acquiredTexture);
+	}
+
+	if (m_depthCopy && m_frameSubmitsDepth && m_acquiredDepthTexture.IsValid())
+	{
+		m_varjoHMD->CopyDepthTexture_RenderThread(RHICmdList, m_acquiredDepthTexture, m_depthTexture);
+	}
+
+	// Leave the images in the state the compositor samples them in before they are released.
+	RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, m_acquiredTexture);
+	if (m_frameSubmitsDepth && m_acquiredDepthTexture.IsValid())
+	{
+		RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, m_acquiredDepthTexture);
+	}
 }
 
 void VarjoCustomPresent::SetNeedReinitRendererAPI()
@@ -248,27 +730,26 @@ void VarjoCustomPresent::Shutdown()
 			m_frameInfo = nullptr;
 		}
 
+		m_textures.Empty();
+		m_imageTextures.Empty();
+		m_acquiredTexture.SafeRelease();
+		m_msaaTextures.Empty();
+		m_msaaTarget.SafeRelease();
 		if (m_swapChain != nullptr)
 		{
 			varjo_FreeSwapChain(m_swapChain);
 			m_swapChain = nullptr;
 		}
 
+		m_depthTexture.SafeRelease();
+		m_depthTextures.Empty();
+		m_acquiredDepthTexture.SafeRelease();
 		if (m_depthSwapChain != nullptr)
 		{
 			varjo_FreeSwapChain(m_depthSwapChain);
 			m_depthSwapChain = nullptr;
 		}
 
-		if (m_submitInfo)
-		{
-			varjo_FreeSubmitInfo(m_submitInfo);
-			m_submitInfo = nullptr;
-		}
-
-		varjo_D3D11ShutDown(m_session);
-
-		m_graphicsInfo = nullptr;
 		m_session = nullptr;
 		});
 
@@ -291,17 +772,6 @@ bool VarjoCustomPresent::getButtonEvent(int& button, bool& pressed) const
 	return false;
 }
 
-TArray<ID3D11Texture2D*> GetSwapChainTextures(varjo_Session* session, varjo_GraphicsInfo* info) {
-	TArray<ID3D11Texture2D*> d3dTextures;
-	for (int32_t i = 0; i < info->swapChainTextureCount; i++)
-	{
-		ID3D11Texture2D* texture = varjo_ToD3D11Texture(info->swapChainTextures[i]);
-		d3dTextures.Add(texture);
-	}
-
-	return d3dTextures;
-}
-
 void VarjoCustomPresent::getFocusViewPosAndSize(EStereoscopicPass stereoPass, float& x, float& y, float& width, float& height) const
 {
 	switch (static_cast<int>(stereoPass))
@@ -323,6 +793,13 @@ void VarjoCustomPresent::getFocusViewPosAndSize(EStereoscopicPass stereoPass, fl
 			y = 0.0f;
 			width = 1.0f;
 			height = 1.0f;
-			break;
+			return;
 	}
+
+	// The narrowed focus frustum keeps its center inside the context view.
+	const float focusAreaScale = m_renderFrame.focusAreaScale;
+	x += width * (1.0f - focusAreaScale) * 0.5f;
+	y += height * (1.0f - focusAreaScale) * 0.5f;
+	width *= focusAreaScale;
+	height *= focusAreaScale;
 }
@@ -9,25 +9,10 @@
 #include "Varjo.h"
 #include "Varjo_layers.h"
 
-#if PLATFORM_WINDOWS
-#include "Windows/WindowsHWrapper.h"
-#include "Windows/AllowWindowsPlatformTypes.h"
-THIRD_PARTY_INCLUDES_START
-__pragma (warning(push)) __pragma(warning(disable: 4005)) /* macro redefinition */
-// Varjo API
-#include "Varjo_d3d11.h"
-
-// D3D11 Specific
-#include <d3dcommon.h>
-#include <d3dcompiler.h>
-#pragma comment(lib, "d3dcompiler.lib")
-#pragma comment(lib, "d3d11.lib")
-
-__pragma (warning(pop))
-THIRD_PARTY_INCLUDES_END
-#include "Windows/HideWindowsPlatformTypes.h"
-#endif
-
+/**
+ * API-neutral part of the Varjo render bridge: frame loop, layer submission, swap chain image acquisition and
+ * the depth pipeline. Backends per RHI create the swap chains and import their images as engine textures.
+ */
 class VarjoCustomPresent : public FXRRenderBridge
 {
 public:
@@ -36,11 +21,16 @@ public:
 
 	void Init();
 	virtual void varjoInit() = 0;
-	virtual void varjoSubmit() = 0;
+	virtual void varjoSubmit();
 	bool isInitialized() const;
+	// Suspended bridges keep their session and swap chains but do not begin or submit frames. Render thread.
+	void setSuspended(bool suspended) { m_suspended = suspended; }
+	bool isSuspended() const { return m_suspended; }
 	void OnBackBufferResize() override;
 	bool Present(int& InOutSyncInterval) override;
-	virtual void BeginRendering();
+	// Begins a frame rendered with viewCount views (all four, or only the two context views) at the given context
+	// and focus resolution fractions, with the focus views narrowed to focusAreaScale of the runtime's. Render thread.
+	virtual void BeginRendering(FRHITexture2D* RenderTarget, int32_t viewCount, float contextFraction, float focusFraction, float focusAreaScale);
 	void WaitSync();
 	virtual void FinishRendering(FRHICommandListImmediate& RHICmdList);
 	virtual void UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI) = 0;
@@ -49,31 +39,111 @@ public:
 	virtual void Reset();
 	virtual void Shutdown();
 	void PostPresent();
-	virtual bool CreateRenderTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) = 0;
-	virtual bool CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) = 0;
+	virtual uint32 GetNumberOfBufferedFrames() const { return rendersIntoSwapChain() && m_textureCount > 0 ? m_textureCount : 1; }
+	virtual bool CreateRenderTargetTexture(uint32 Index, uint32 NumSamples, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture);
+	virtual bool CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture);
+	bool NeedReAllocateDepthTexture(FRHITexture* DepthTarget) const;
 	virtual void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) = 0;
-	void setResolutionFraction(float resolutionFraction) { m_resolutionFraction = resolutionFraction; };
-	float getResolutionFraction() const { return m_resolutionFraction; };
+	// Fraction of the frame being rendered. Render thread.
+	float getResolutionFraction(int32_t viewIndex) const { return m_renderFrame.getResolutionFraction(viewIndex); };
+	// Compositor frame period averaged from display times, 0 until measured. Render thread.
+	float getFramePeriodMs() const { return m_framePeriodMs; }
 	bool getButtonEvent(int& button, bool& pressed) const;
 	void renderOcclusionMesh(FRHICommandList& RHICmdList, int viewIndex);
 	void handleVarjoEvents(UGameViewportClient* gameViewportClient);
 	void getFocusViewPosAndSize(EStereoscopicPass stereoPass, float& x, float& y, float& width, float& height) const;
-	void SetDepthSubmissionEnabled(bool enabled) { m_submitDepth = enabled; };
+	// Render thread.
+	void SetDepthSubmissionEnabled(bool enabled);
 
 protected:
-	virtual FTextureRHIRef CreateTexture(ID3D11Texture2D* d3dTexture) const = 0;
+	static const int32_t VIEW_COUNT = 4;
+
+	// Engine render target for a color swap chain image.
+	virtual FTexture2DRHIRef createColorImageTexture(int32_t index) const = 0;
+	// Depth swap chain format matching the engine's depth-stencil layout.
+	virtual varjo_TextureFormat getEngineDepthFormat() const = 0;
+	// False when the engine renders into its own targets and the backend copies them into the swap chains at submit.
+	virtual bool rendersIntoSwapChain() const { return true; }
+	void initViewports();
+	void updateFramePeriod();
+	// Releases the depth image acquired for this frame. Returns true if depth is submitted with the frame.
+	bool releaseDepthImage();
+	void varjoEndFrame(bool submitDepth);
+	// Everything the submission of a frame depends on, captured on the render thread when the frame begins. The
+	// render thread moves on to the next frame's values while the RHI thread still submits this one.
+	struct FSubmitFrame
+	{
+		int64_t frameNumber = 0;
+		bool submitDepth = false;
+		int32_t viewCount = VIEW_COUNT;
+		float contextFraction = 1.0f;
+		float focusFraction = 1.0f;
+		float focusAreaScale = 1.0f;
+		double projections[VIEW_COUNT][16]{};
+		double viewMatrices[VIEW_COUNT][16]{};
+
+		float getResolutionFraction(int32_t viewIndex) const { return viewIndex < 2 ? contextFraction : focusFraction; }
+	};
+	// Begins the frame and acquires its images. RHI thread.
+	void beginFrame(FRHITexture2D* RenderTarget, const FSubmitFrame& frame);
+	// Points the engine targets and the acquired-image textures at the images held for the frame. RHI thread.
+	void aliasAcquiredImages(FRHITexture2D* RenderTarget);
+	void setDepthMapping(varjo_ViewExtensionDepth& depthView) const;
+	FTexture2DRHIRef createMsaaTarget(uint32 numSamples) const;
+
+	// Depth swap chain, created on first use and released a while after depth submission is turned off.
+	virtual varjo_SwapChain* createDepthSwapChain(const varjo_SwapChainConfig2& config) = 0;
+	// Engine texture for a depth swap chain image, or null if the images cannot be used as engine targets.
+	virtual FTexture2DRHIRef createDepthImageTexture(int32_t index, EPixelFormat format) const = 0;
+	virtual void releaseDepthPipeline();
+	bool createDepthPipeline();
+	bool wantsDepthSwapChain() const;
+	void resolveMsaaTarget(FRHICommandListImmediate& RHICmdList, FRHITexture2D* resolveTarget);
+	varjo_TextureFormat getDepthSwapChainFormat() const;
+	static int32 getDepthBytesPerPixel(varjo_TextureFormat format);
+
 	class FVarjoHMD* m_varjoHMD;
-	ID3D11Device* m_device;
-	ID3D11DeviceContext* m_deviceContext;
 	varjo_Session* m_session;
-	varjo_GraphicsInfo* m_graphicsInfo;
-	varjo_SubmitInfo* m_submitInfo;
 	varjo_SwapChain* m_swapChain;
 	varjo_SwapChain* m_depthSwapChain;
-	ID3D11Texture2D* m_texture;
-	float m_resolutionFraction = 1.0f;
+	varjo_Nanoseconds m_lastDisplayTime = 0;
+	float m_framePeriodMs = 0.0f;
+	// Set when a frame begins on the RHI thread, in order with the command lists that render it. RHI thread.
 	bool m_inFrame = false;
+	bool m_suspended = false;
 	bool m_submitDepth = false;
+	bool m_depthSCAcquired = false;
+	// Depth swap chain format differs from scene depth; scene depth is converted into it in FinishRendering.
+	bool m_depthCopy = false;
+	int32_t m_depthIndex = -1;
+	// Engine scene depth. Aliased to the acquired image of m_depthTextures, converted into it when
+	// m_depthCopy is set, or a plain engine target while there is no depth swap chain.
+	FTexture2DRHIRef m_depthTexture;
+	TArray<FTexture2DRHIRef> m_depthTextures;
+	bool m_depthTargetUsesSwapChain = false;
+	double m_depthDisabledTime = 0.0;
+	// Engine renders into a multisampled target per buffered frame, resolved into the acquired image in FinishRendering.
+	uint32 m_numSamples = 1;
+	int32_t m_colorIndex = -1;
+	FTexture2DRHIRef m_msaaTarget;
+	uint32_t m_textureCount = 0;
+	// One render target per swap chain image, handed to the engine as its buffered viewport targets.
+	TArray<FTexture2DRHIRef> m_textures;
+	// A second wrapper per swap chain image. Never handed to the engine, so it always refers to its own image even
+	// after an engine target has been aliased to another one.
+	TArray<FTexture2DRHIRef> m_imageTextures;
+	// Aliased to the acquired color and depth images, so render thread commands can target them before they are known.
+	FTexture2DRHIRef m_acquiredTexture;
+	FTexture2DRHIRef m_acquiredDepthTexture;
+	// Whether depth is submitted with the frame being rendered. Render thread.
+	bool m_frameSubmitsDepth = false;
+	// The frame being rendered. Render thread.
+	FSubmitFrame m_renderFrame;
+	// The frame being submitted. RHI thread.
+	FSubmitFrame m_submitFrame;
+	// Multisampled engine targets, one per buffered frame, when the engine asks for MSAA.
+	TArray<FTexture2DRHIRef> m_msaaTextures;
+	varjo_Viewport m_viewports[VIEW_COUNT];
 
 	// Varjo API related
 	varjo_FrameInfo* m_frameInfo;
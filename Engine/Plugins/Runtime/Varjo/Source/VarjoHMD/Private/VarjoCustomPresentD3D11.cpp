@@ -4,6 +4,25 @@
 #include "VarjoHMD.h"
 #include "VarjoHMDPrivateRHI.h"
 
+uint64 VarjoGetCompositorAdapterLuid(varjo_Session* session)
+{
+	const varjo_Luid luid = varjo_D3D11GetLuid(session);
+	if (varjo_GetError(session) != varjo_NoError)
+	{
+		return 0;
+	}
+	return (uint64(uint32(luid.highPart)) << 32) | uint64(luid.lowPart);
+}
+
+void VarjoCheckEngineAdapterLuid(varjo_Session* session, const LUID& engineLuid)
+{
+	const uint64 compositorLuid = VarjoGetCompositorAdapterLuid(session);
+	const uint64 renderLuid = (uint64(uint32(engineLuid.HighPart)) << 32) | uint64(engineLuid.LowPart);
+	UE_CLOG(compositorLuid != 0 && compositorLuid != renderLuid, LogHMD, Warning,
+		TEXT("Engine renders on adapter LUID 0x%016llx but the Varjo compositor runs on 0x%016llx. Every frame is copied between the GPUs; remove -graphicsadapter or r.GraphicsAdapter overrides to render on the headset's GPU."),
+		renderLuid, compositorLuid);
+}
+
 VarjoCustomPresentD3D11::VarjoCustomPresentD3D11(class FVarjoHMD* varjoHMD) :
 	VarjoCustomPresent(varjoHMD)
 {
@@ -19,118 +38,34 @@ void VarjoCustomPresentD3D11::varjoInit()
 	m_device = static_cast<ID3D11Device*>(GDynamicRHI->RHIGetNativeDevice());
 	m_device->GetImmediateContext(&m_deviceContext);
 
-	// Init varjo d3d11
-	varjo_SwapChainConfig defaultScc = varjo_GetDefaultSwapChainConfig(m_session);
-
-	varjo_SwapChainConfig2 scConfig{ varjo_TextureFormat_B8G8R8A8_SRGB, defaultScc.numberOfTextures, defaultScc.textureWidth, defaultScc.textureHeight, 1 };
-	m_swapChain = varjo_D3D11CreateSwapChain(m_session, m_device, &scConfig);
-
-	varjo_SwapChainConfig2 depthScConfig{ varjo_DepthTextureFormat_D32_FLOAT, defaultScc.numberOfTextures, defaultScc.textureWidth, defaultScc.textureHeight, 1 };
-	m_depthSwapChain = varjo_D3D11CreateSwapChain(m_session, m_device, &depthScConfig);
-
-	m_frameInfo = varjo_CreateFrameInfo(m_session);
-
-	m_textureCount = defaultScc.numberOfTextures;
-
-	varjo_LayoutDefaultViewports(m_session, m_viewports);
-}
-
-void VarjoCustomPresentD3D11::BeginRendering()
-{
-	VarjoCustomPresent::BeginRendering();
-
-	int32_t scIndex;
-	varjo_AcquireSwapChainImage(m_swapChain, &scIndex);
-	AliasTextureResources(m_aliasTexture, m_textures[scIndex]);
-}
-
-void VarjoCustomPresentD3D11::FinishRendering(FRHICommandListImmediate& RHICmdList)
-{
-	m_depthSCAcquired = false;
-	if (m_submitDepth && m_depthTexture.IsValid())
+	IDXGIDevice* dxgiDevice = nullptr;
+	if (SUCCEEDED(m_device->QueryInterface(__uuidof(IDXGIDevice), (void**)&dxgiDevice)))
 	{
-		int32_t scIndex = -1;
-		varjo_AcquireSwapChainImage(m_depthSwapChain, &scIndex);
-		m_depthSCAcquired = true;
-		if (0 <= scIndex && scIndex < m_depthTextures.Num())
+		IDXGIAdapter* adapter = nullptr;
+		DXGI_ADAPTER_DESC adapterDesc;
+		if (SUCCEEDED(dxgiDevice->GetAdapter(&adapter)) && SUCCEEDED(adapter->GetDesc(&adapterDesc)))
 		{
-			m_varjoHMD->CopyDepthTexture_RenderThread(RHICmdList, m_depthTextures[scIndex], m_depthTexture);
+			VarjoCheckEngineAdapterLuid(m_session, adapterDesc.AdapterLuid);
 		}
-	}
-}
-
-void VarjoCustomPresentD3D11::varjoSubmit()
-{
-	varjo_ReleaseSwapChainImage(m_swapChain);
-	if (m_depthSCAcquired)
-	{
-		varjo_ReleaseSwapChainImage(m_depthSwapChain);
+		if (adapter != nullptr)
+		{
+			adapter->Release();
+		}
+		dxgiDevice->Release();
 	}
 
-	// Check that all OK
-	varjo_Error error = varjo_GetError(m_session);
-	if (error != varjo_NoError)
-	{
-		UE_LOG(LogHMD, Log, TEXT("Error existed before varjoSubmit. Skip submit. Error code: %d."), error);
-		return;
-	}
+	// Init varjo d3d11
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	const FIntPoint atlasSize = layout.GetAtlasSize();
 
-	if (m_inFrame)
-	{
-		varjo_LayerMultiProj layer;
-		layer.header.type = varjo_LayerMultiProjType;
-		layer.header.flag = varjo_LayerFlagNone;
-		layer.space = varjo_SpaceLocal;
-		layer.viewCount = VIEW_COUNT;
-		varjo_LayerMultiProjView views[VIEW_COUNT]{};
-		varjo_ViewExtensionDepth depthViews[VIEW_COUNT]{};
-		for (int i = 0; i < VIEW_COUNT; i++)
-		{
-			memcpy(views[i].projection.value, m_frameInfo->views[i].projectionMatrix, 16 * sizeof(double));
-			memcpy(views[i].view.value, m_frameInfo->views[i].viewMatrix, 16 * sizeof(double));
-			views[i].viewport.swapChain = m_swapChain;
-			views[i].viewport.x = m_viewports[i].x * m_resolutionFraction;
-			views[i].viewport.y = m_viewports[i].y * m_resolutionFraction;
-			views[i].viewport.width = m_viewports[i].width * m_resolutionFraction;
-			views[i].viewport.height = m_viewports[i].height * m_resolutionFraction;
-			views[i].viewport.arrayIndex = 0;
-			views[i].extension = m_submitDepth ? (varjo_ViewExtension*)& depthViews[i] : nullptr;
-
-			if (m_submitDepth)
-			{
-				depthViews[i].header.type = varjo_ViewExtensionDepthType;
-				depthViews[i].header.next = nullptr;
-				depthViews[i].minDepth = 0.0f;
-				depthViews[i].maxDepth = 1.0f;
-				depthViews[i].nearZ = std::numeric_limits<float>::infinity();
-				depthViews[i].farZ = GNearClippingPlane / m_varjoHMD->GetWorldToMetersScale();
-				depthViews[i].viewport.swapChain = m_depthSwapChain;
-				depthViews[i].viewport.x = views[i].viewport.x;
-				depthViews[i].viewport.y = views[i].viewport.y;
-				depthViews[i].viewport.width = views[i].viewport.width;
-				depthViews[i].viewport.height = views[i].viewport.height;
-				depthViews[i].viewport.arrayIndex = 0;
-			}
-		}
-		layer.views = &views[0];
-		varjo_LayerHeader* layerPtrs[1]{ &layer.header };
+	varjo_SwapChainConfig2 scConfig{ layout.GetColorFormat(), layout.GetNumberOfTextures(), atlasSize.X, atlasSize.Y, 1 };
+	m_swapChain = varjo_D3D11CreateSwapChain(m_session, m_device, &scConfig);
 
-		varjo_SubmitInfoLayers submitInfoLayers;
-		submitInfoLayers.flags = varjo_SubmitFlag_Async;
-		submitInfoLayers.frameNumber = m_frameInfo->frameNumber;
-		submitInfoLayers.layerCount = 1;
-		submitInfoLayers.layers = layerPtrs;
+	m_frameInfo = varjo_CreateFrameInfo(m_session);
 
-		varjo_EndFrameWithLayers(m_session, &submitInfoLayers);
-		m_inFrame = false;
-	}
+	m_textureCount = layout.GetNumberOfTextures();
 
-	error = varjo_GetError(m_session);
-	if (error != varjo_NoError)
-	{
-		UE_LOG(LogHMD, Log, TEXT("varjoSubmit failed, error code: %d."), error);
-		return;
-	}
+	initViewports();
 }
 
 void VarjoCustomPresentD3D11::UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI)
@@ -138,33 +73,35 @@ void VarjoCustomPresentD3D11::UpdateViewport(const FViewport& Viewport, FRHIView
 	check(IsInGameThread());
 	check(InViewportRHI);
 
-	const FTexture2DRHIRef& RT = Viewport.GetRenderTargetTexture();
-	check(IsValidRef(RT));
-	if (m_texture != nullptr)
-	{
-		m_texture->Release();
-	}
-	m_texture = (ID3D11Texture2D*)RT->GetNativeResource();
-	m_texture->AddRef();
-
 	InViewportRHI->SetCustomPresent(this);
 }
 
-FTextureRHIRef VarjoCustomPresentD3D11::CreateTexture(ID3D11Texture2D* d3dTexture) const
+FTexture2DRHIRef VarjoCustomPresentD3D11::createColorImageTexture(int32_t index) const
 {
 	FD3D11DynamicRHI* DynamicRHI = static_cast<FD3D11DynamicRHI*>(GDynamicRHI);
+	ID3D11Texture2D* d3dTexture = varjo_ToD3D11Texture(varjo_GetSwapChainImage(m_swapChain, index));
 	const uint32 TexCreateFlags = TexCreate_ShaderResource | TexCreate_RenderTargetable;
-	return DynamicRHI->RHICreateTexture2DFromResource(PF_B8G8R8A8, TexCreateFlags, FClearValueBinding::Black, d3dTexture).GetReference();
+	return DynamicRHI->RHICreateTexture2DFromResource(m_varjoHMD->GetAtlasLayout().GetColorPixelFormat(), TexCreateFlags, FClearValueBinding::Black, d3dTexture);
 }
 
-#ifdef VARJO_USE_CUSTOM_ENGINE
-FTextureRHIRef VarjoCustomPresentD3D11::CreateDepthTexture(ID3D11Texture2D* d3dTexture) const
+varjo_TextureFormat VarjoCustomPresentD3D11::getEngineDepthFormat() const
+{
+	return GPixelFormats[PF_DepthStencil].PlatformFormat == DXGI_FORMAT_R24G8_TYPELESS ? varjo_DepthTextureFormat_D24_UNORM_S8_UINT : varjo_DepthTextureFormat_D32_FLOAT_S8_UINT;
+}
+
+varjo_SwapChain* VarjoCustomPresentD3D11::createDepthSwapChain(const varjo_SwapChainConfig2& config)
+{
+	varjo_SwapChainConfig2 depthScConfig = config;
+	return varjo_D3D11CreateSwapChain(m_session, m_device, &depthScConfig);
+}
+
+FTexture2DRHIRef VarjoCustomPresentD3D11::createDepthImageTexture(int32_t index, EPixelFormat format) const
 {
 	FD3D11DynamicRHI* DynamicRHI = static_cast<FD3D11DynamicRHI*>(GDynamicRHI);
+	ID3D11Texture2D* d3dTexture = varjo_ToD3D11Texture(varjo_GetSwapChainImage(m_depthSwapChain, index));
 	const uint32 TexCreateFlags = TexCreate_ShaderResource | TexCreate_DepthStencilTargetable;
-	return DynamicRHI->RHICreateTexture2DFromResource(PF_Depth, TexCreateFlags, FClearValueBinding::Black, d3dTexture).GetReference();
+	return DynamicRHI->RHICreateTexture2DFromResource(format, TexCreateFlags, FClearValueBinding::DepthFar, d3dTexture);
 }
-#endif
 
 void VarjoCustomPresentD3D11::AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture)
 {
@@ -172,37 +109,17 @@ void VarjoCustomPresentD3D11::AliasTextureResources(FRHITexture* DestTexture, FR
 	DynamicRHI->RHIAliasTextureResources(DestTexture, SrcTexture);
 }
 
-bool VarjoCustomPresentD3D11::CreateRenderTargetTexture(FTexture2DRHIRef& OutTargetableTexture,
-	FTexture2DRHIRef& OutShaderResourceTexture)
-{
-	for (uint32_t i = 0; i < m_textureCount; i++)
-	{
-		m_textures.Add(CreateTexture(varjo_ToD3D11Texture(varjo_GetSwapChainImage(m_swapChain, i)))->GetTexture2D());
-	}
-	OutTargetableTexture = OutShaderResourceTexture = m_aliasTexture = CreateTexture(varjo_ToD3D11Texture(varjo_GetSwapChainImage(m_swapChain, 0)))->GetTexture2D();
-	return true;
-}
-
 bool VarjoCustomPresentD3D11::CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture,
 	FTexture2DRHIRef& OutShaderResourceTexture)
 {
 #ifdef VARJO_USE_CUSTOM_ENGINE
-	if (m_depthTexture.IsValid())
+	if (m_textureCount == 0)
 	{
 		return false;
 	}
 
-	for (uint32_t i = 0; i < m_textureCount; i++)
-	{
-		m_depthTextures.Add(CreateDepthTexture(varjo_ToD3D11Texture(varjo_GetSwapChainImage(m_depthSwapChain, i)))->GetTexture2D());
-	}
-
-	FRHIResourceCreateInfo CreateInfo;
-	CreateInfo.ClearValueBinding = FClearValueBinding(0.0f);
-	RHICreateTargetableShaderResource2D(4096, 3200, PF_DepthStencil, 1, TexCreate_None, TexCreate_DepthStencilTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
-	m_depthTexture = OutTargetableTexture;
-	return true;
+	return VarjoCustomPresent::CreateDepthTargetTexture(OutTargetableTexture, OutShaderResourceTexture);
 #else
 	return false;
 #endif
-}
\ No newline at end of file
+}
@@ -4,6 +4,30 @@
 
 #include "VarjoCustomPresent.h"
 
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#include "Windows/AllowWindowsPlatformTypes.h"
+THIRD_PARTY_INCLUDES_START
+__pragma (warning(push)) __pragma(warning(disable: 4005)) /* macro redefinition */
+// Varjo API
+#include "Varjo_d3d11.h"
+
+// D3D11 Specific
+#include <d3dcommon.h>
+#include <d3dcompiler.h>
+#pragma comment(lib, "d3dcompiler.lib")
+#pragma comment(lib, "d3d11.lib")
+
+__pragma (warning(pop))
+THIRD_PARTY_INCLUDES_END
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+// LUID of the adapter the Varjo compositor renders on, 0 if the runtime does not report one.
+uint64 VarjoGetCompositorAdapterLuid(varjo_Session* session);
+// Warns when the engine renders on a different adapter than the compositor, e.g. forced with -graphicsadapter.
+void VarjoCheckEngineAdapterLuid(varjo_Session* session, const LUID& engineLuid);
+
 class VarjoCustomPresentD3D11 : public VarjoCustomPresent
 {
 public:
@@ -12,26 +36,16 @@ public:
 
 	void varjoInit() override;
 	virtual void UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI);
-	virtual void FinishRendering(FRHICommandListImmediate& RHICmdList) override;
-	virtual void varjoSubmit() override;
-	virtual FTextureRHIRef CreateTexture(ID3D11Texture2D* d3dTexture) const override;
 	virtual void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) override;
-	virtual bool CreateRenderTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override;
 	virtual bool CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override;
-	virtual void BeginRendering() override;
 
-private:
-	static const int32_t VIEW_COUNT = 4;
-
-#ifdef VARJO_USE_CUSTOM_ENGINE
-	FTextureRHIRef CreateDepthTexture(ID3D11Texture2D* d3dTexture) const;
-#endif
+protected:
+	virtual FTexture2DRHIRef createColorImageTexture(int32_t index) const override;
+	virtual varjo_TextureFormat getEngineDepthFormat() const override;
+	virtual varjo_SwapChain* createDepthSwapChain(const varjo_SwapChainConfig2& config) override;
+	virtual FTexture2DRHIRef createDepthImageTexture(int32_t index, EPixelFormat format) const override;
 
-	uint32_t m_textureCount = 0;
-	FTexture2DRHIRef m_aliasTexture;
-	TArray<FTexture2DRHIRef> m_textures;
-	FTexture2DRHIRef m_depthTexture;
-	TArray<FTexture2DRHIRef> m_depthTextures;
-	varjo_Viewport m_viewports[VIEW_COUNT];
-	bool m_depthSCAcquired = false;
+private:
+	ID3D11Device* m_device{nullptr};
+	ID3D11DeviceContext* m_deviceContext{nullptr};
 };
@@ -3,6 +3,7 @@
 #include "VarjoCustomPresentD3D12.h"
 #include "D3D12RHIPrivate.h"
 #include "XRThreadUtils.h"
+#include "VarjoHMD.h"
 
 VarjoCustomPresentD3D12::VarjoCustomPresentD3D12(class FVarjoHMD* varjoHMD) :
 	VarjoCustomPresent(varjoHMD)
@@ -15,103 +16,179 @@ VarjoCustomPresentD3D12::~VarjoCustomPresentD3D12()
 
 void VarjoCustomPresentD3D12::varjoInit()
 {
-	ExecuteOnRHIThread([this]() {
+	ID3D12Device* d3d12Device = static_cast<ID3D12Device*>(GDynamicRHI->RHIGetNativeDevice());
+	VarjoCheckEngineAdapterLuid(m_session, d3d12Device->GetAdapterLuid());
 
-		typedef HRESULT(STDAPICALLTYPE *D3D11On12CreateDevice)(
-			IUnknown* pDevice,
-			UINT Flags,
-			CONST D3D_FEATURE_LEVEL* pFeatureLevels,
-			UINT FeatureLevels,
-			IUnknown* CONST* ppCommandQueues,
-			UINT NumQueues,
-			UINT NodeMask,
-			ID3D11Device** ppDevice,
-			ID3D11DeviceContext** ppImmediateContext,
-			D3D_FEATURE_LEVEL* pChosenFeatureLevel);
-
-		void* d3d11DllHandle = FWindowsPlatformProcess::GetDllHandle(TEXT("d3d11.dll"));
-		if (d3d11DllHandle == nullptr)
-		{
-			UE_LOG(LogHMD, Log, TEXT("d3d11.dll could not found."));
-			return;
-		}
-		D3D11On12CreateDevice D3D11On12CreateDeviceFunc = (D3D11On12CreateDevice)FPlatformProcess::GetDllExport(d3d11DllHandle, TEXT("D3D11On12CreateDevice"));
-
-		if (D3D11On12CreateDeviceFunc == nullptr)
+	ExecuteOnRHIThread([this]() {
+		m_nativeSwapChains = initNativeSwapChains();
+		if (!m_nativeSwapChains)
 		{
-			UE_LOG(LogHMD, Log, TEXT("D3D11On12CreateDeviceFunc could not found."));
-			return;
+			UE_LOG(LogHMD, Log, TEXT("D3D12 swap chains not available, falling back to D3D11On12 interop."));
+			if (!initD3D11On12())
+			{
+				return;
+			}
 		}
 
-		static bool initDone = false;
-		ID3D12Device* d3d12Device = static_cast<ID3D12Device*>(GDynamicRHI->RHIGetNativeDevice());
-
-		FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
-		ID3D12CommandQueue* commandQueue = DynamicRHI->RHIGetD3DCommandQueue();
-		UINT d3d11DeviceFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
-		HRESULT hr = D3D11On12CreateDeviceFunc(
-			d3d12Device,
-			d3d11DeviceFlags,
-			nullptr,
-			0,
-			reinterpret_cast<IUnknown**>(&commandQueue),
-			1,
-			0,
-			&m_device,
-			&m_deviceContext,
-			nullptr
-		);
-		check(SUCCEEDED(hr));
-
-		hr = m_device->QueryInterface(__uuidof(ID3D11On12Device), (void**)&m_d3d11On12Device);
-		check(SUCCEEDED(hr));
-		m_graphicsInfo = varjo_D3D11Init(m_session, m_device, varjo_TextureFormat_B8G8R8A8_SRGB, nullptr);
 		m_frameInfo = varjo_CreateFrameInfo(m_session);
-		m_submitInfo = varjo_CreateSubmitInfo(m_session);
-		varjo_LayoutDefaultViewports(m_session, m_submitInfo->viewports);
+		m_textureCount = m_varjoHMD->GetAtlasLayout().GetNumberOfTextures();
+
+		initViewports();
 	});
 }
 
-void VarjoCustomPresentD3D12::BeginRendering()
+bool VarjoCustomPresentD3D12::initNativeSwapChains()
 {
-	VarjoCustomPresent::BeginRendering();
-	varjo_BeginFrame(m_session, m_submitInfo);
+	FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+	ID3D12CommandQueue* commandQueue = DynamicRHI->RHIGetD3DCommandQueue();
+
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	const FIntPoint atlasSize = layout.GetAtlasSize();
+
+	varjo_SwapChainConfig2 scConfig{ layout.GetColorFormat(), layout.GetNumberOfTextures(), atlasSize.X, atlasSize.Y, 1 };
+	m_swapChain = varjo_D3D12CreateSwapChain(m_session, commandQueue, &scConfig);
+	if (m_swapChain == nullptr || varjo_GetError(m_session) != varjo_NoError)
+	{
+		if (m_swapChain != nullptr)
+		{
+			varjo_FreeSwapChain(m_swapChain);
+			m_swapChain = nullptr;
+		}
+		return false;
+	}
+	return true;
 }
 
-void VarjoCustomPresentD3D12::varjoSubmit()
+bool VarjoCustomPresentD3D12::initD3D11On12()
 {
-	// Check that all OK
-	varjo_Error error = varjo_GetError(m_session);
-	if (error != varjo_NoError)
+	typedef HRESULT(STDAPICALLTYPE *D3D11On12CreateDevice)(
+		IUnknown* pDevice,
+		UINT Flags,
+		CONST D3D_FEATURE_LEVEL* pFeatureLevels,
+		UINT FeatureLevels,
+		IUnknown* CONST* ppCommandQueues,
+		UINT NumQueues,
+		UINT NodeMask,
+		ID3D11Device** ppDevice,
+		ID3D11DeviceContext** ppImmediateContext,
+		D3D_FEATURE_LEVEL* pChosenFeatureLevel);
+
+	void* d3d11DllHandle = FWindowsPlatformProcess::GetDllHandle(TEXT("d3d11.dll"));
+	if (d3d11DllHandle == nullptr)
 	{
-		UE_LOG(LogHMD, Log, TEXT("Error existed before varjoSubmit. Skip submit. Error code: %d."), error);
-		return;
+		UE_LOG(LogHMD, Log, TEXT("d3d11.dll could not found."));
+		return false;
+	}
+	D3D11On12CreateDevice D3D11On12CreateDeviceFunc = (D3D11On12CreateDevice)FPlatformProcess::GetDllExport(d3d11DllHandle, TEXT("D3D11On12CreateDevice"));
+
+	if (D3D11On12CreateDeviceFunc == nullptr)
+	{
+		UE_LOG(LogHMD, Log, TEXT("D3D11On12CreateDeviceFunc could not found."));
+		return false;
 	}
 
-	varjo_Texture varjoTexture = varjo_FromD3D11Texture(m_texture);
-	int viewCount = m_graphicsInfo->viewCount;
-	for (int32_t i = 0; i < viewCount; i++)
+	ID3D12Device* d3d12Device = static_cast<ID3D12Device*>(GDynamicRHI->RHIGetNativeDevice());
+
+	FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+	ID3D12CommandQueue* commandQueue = DynamicRHI->RHIGetD3DCommandQueue();
+	UINT d3d11DeviceFlags = D3D11_CREATE_DEVICE_BGRA_SUPPORT;
+	HRESULT hr = D3D11On12CreateDeviceFunc(
+		d3d12Device,
+		d3d11DeviceFlags,
+		nullptr,
+		0,
+		reinterpret_cast<IUnknown**>(&commandQueue),
+		1,
+		0,
+		&m_device,
+		&m_deviceContext,
+		nullptr
+	);
+	check(SUCCEEDED(hr));
+
+	hr = m_device->QueryInterface(__uuidof(ID3D11On12Device), (void**)&m_d3d11On12Device);
+	check(SUCCEEDED(hr));
+
+	// Depth is copied with CopyResource here, which cannot convert formats.
+	UE_CLOG(m_depthCopy, LogHMD, Log, TEXT("16-bit depth is not supported with D3D11On12 interop, submitting engine depth format."));
+	m_depthCopy = false;
+
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	const FIntPoint atlasSize = layout.GetAtlasSize();
+
+	varjo_SwapChainConfig2 scConfig{ layout.GetColorFormat(), layout.GetNumberOfTextures(), atlasSize.X, atlasSize.Y, 1 };
+	m_swapChain = varjo_D3D11CreateSwapChain(m_session, m_device, &scConfig);
+	return true;
+}
+
+bool VarjoCustomPresentD3D12::copyToSwapChain(varjo_SwapChain* swapChain, ID3D11Texture2D* source)
+{
+	if (swapChain == nullptr || source == nullptr)
 	{
-		m_submitInfo->textures[i] = varjoTexture;
+		return false;
+	}
 
-		m_submitInfo->viewports[i].x *= m_resolutionFraction;
-		m_submitInfo->viewports[i].y *= m_resolutionFraction;
-		m_submitInfo->viewports[i].width *= m_resolutionFraction;
-		m_submitInfo->viewports[i].height *= m_resolutionFraction;
+	int32_t index = -1;
+	varjo_AcquireSwapChainImage(swapChain, &index);
+	if (index < 0)
+	{
+		return false;
 	}
 
-	if (m_inFrame)
+	ID3D11Texture2D* destination = varjo_ToD3D11Texture(varjo_GetSwapChainImage(swapChain, index));
+	m_d3d11On12Device->AcquireWrappedResources(reinterpret_cast<ID3D11Resource**>(&source), 1);
+	m_deviceContext->CopyResource(destination, source);
+	m_d3d11On12Device->ReleaseWrappedResources(reinterpret_cast<ID3D11Resource**>(&source), 1);
+	return true;
+}
+
+ID3D11Texture2D* VarjoCustomPresentD3D12::getWrappedDepthTexture()
+{
+	if (m_wrappedDepthTexture == nullptr && m_depthTexture.IsValid())
 	{
-		varjo_EndFrame(m_session, m_frameInfo, m_submitInfo);
-		m_inFrame = false;
+		D3D11_RESOURCE_FLAGS d3d11Flags = { D3D11_BIND_DEPTH_STENCIL };
+		m_d3d11On12Device->CreateWrappedResource(
+			reinterpret_cast<ID3D12Resource*>(m_depthTexture->GetNativeResource()),
+			&d3d11Flags,
+			D3D12_RESOURCE_STATE_DEPTH_WRITE,
+			D3D12_RESOURCE_STATE_DEPTH_WRITE,
+			IID_PPV_ARGS(&m_wrappedDepthTexture)
+		);
 	}
+	return m_wrappedDepthTexture;
+}
 
-	error = varjo_GetError(m_session);
-	if (error != varjo_NoError)
+void VarjoCustomPresentD3D12::varjoSubmit()
+{
+	if (!m_inFrame)
 	{
-		UE_LOG(LogHMD, Log, TEXT("varjoSubmit failed, error code: %d."), error);
 		return;
 	}
+
+	if (m_nativeSwapChains)
+	{
+		// Rendering went straight into the acquired images on the engine's queue. Get the frame's command lists onto
+		// the queue before the release, so the compositor's reads are ordered after them.
+		check(IsInRHIThread() || !IsRunningRHIInSeparateThread());
+		FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+		DynamicRHI->GetAdapter().GetDevice(0)->GetDefaultCommandContext().FlushCommands();
+		varjo_ReleaseSwapChainImage(m_swapChain);
+	}
+	else
+	{
+		const bool colorCopied = copyToSwapChain(m_swapChain, m_texture);
+		m_depthSCAcquired = m_submitFrame.submitDepth && copyToSwapChain(m_depthSwapChain, getWrappedDepthTexture());
+
+		// Make sure the copies have reached the D3D12 queue before the compositor reads the images.
+		m_deviceContext->Flush();
+
+		if (colorCopied)
+		{
+			varjo_ReleaseSwapChainImage(m_swapChain);
+		}
+	}
+
+	varjoEndFrame(releaseDepthImage());
 }
 
 void VarjoCustomPresentD3D12::UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI)
@@ -122,49 +199,186 @@ void VarjoCustomPresentD3D12::UpdateViewport(const FViewport& Viewport, FRHIView
 	const FTexture2DRHIRef& RT = Viewport.GetRenderTargetTexture();
 	check(IsValidRef(RT));
 
-	ExecuteOnRenderThread([&]() {
-		ExecuteOnRHIThread([&]() {
+	if (!m_nativeSwapChains)
+	{
+		// Rebind in order with the frames already queued instead of flushing the render and RHI threads.
+		FTexture2DRHIRef renderTarget = RT;
+		ENQUEUE_RENDER_COMMAND(VarjoD3D12UpdateViewport)(
+			[this, renderTarget](FRHICommandListImmediate& RHICmdList)
+			{
+				RHICmdList.EnqueueLambda([this, renderTarget](FRHICommandListImmediate&)
+				{
+					m_texture = getWrappedTexture(renderTarget);
+					releaseUnusedWrappedTextures();
+				});
+			});
+	}
 
-			ID3D12Resource* d3d12Texture = reinterpret_cast<ID3D12Resource*>(RT->GetNativeResource());
+	InViewportRHI->SetCustomPresent(this);
+}
 
-			if (d3d12Texture == m_d3d12Texture)
-			{
-				return;
-			}
-			m_d3d12Texture = d3d12Texture;
+ID3D11Texture2D* VarjoCustomPresentD3D12::getWrappedTexture(const FTexture2DRHIRef& texture)
+{
+	ID3D12Resource* d3d12Texture = reinterpret_cast<ID3D12Resource*>(texture->GetNativeResource());
+	if (FWrappedTexture* existing = m_wrappedTextures.Find(d3d12Texture))
+	{
+		return existing->wrapped;
+	}
 
-			if (m_texture != nullptr)
-			{
-				m_texture->Release();
-			}
-			D3D11_RESOURCE_FLAGS d3d11Flags = { D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE };
-			m_d3d11On12Device->CreateWrappedResource(
-				m_d3d12Texture,
-				&d3d11Flags,
-				D3D12_RESOURCE_STATE_RENDER_TARGET,
-				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
-				IID_PPV_ARGS(&m_texture)
-			);
+	ID3D11Texture2D* wrapped = nullptr;
+	D3D11_RESOURCE_FLAGS d3d11Flags = { D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE };
+	HRESULT hr = m_d3d11On12Device->CreateWrappedResource(
+		d3d12Texture,
+		&d3d11Flags,
+		D3D12_RESOURCE_STATE_RENDER_TARGET,
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE,
+		IID_PPV_ARGS(&wrapped)
+	);
+	if (FAILED(hr))
+	{
+		UE_LOG(LogHMD, Log, TEXT("CreateWrappedResource failed, error code: 0x%08x."), hr);
+		return nullptr;
+	}
+
+	m_wrappedTextures.Add(d3d12Texture, FWrappedTexture{ texture, wrapped });
+	return wrapped;
+}
+
+void VarjoCustomPresentD3D12::releaseUnusedWrappedTextures()
+{
+	// Targets only this cache still references were dropped by the engine, e.g. after a resize.
+	for (auto it = m_wrappedTextures.CreateIterator(); it; ++it)
+	{
+		FWrappedTexture& entry = it.Value();
+		if (entry.wrapped != m_texture && entry.engineTexture->GetRefCount() == 1)
+		{
+			entry.wrapped->Release();
+			it.RemoveCurrent();
+		}
+	}
+}
+
+FTexture2DRHIRef VarjoCustomPresentD3D12::createTexture(ID3D12Resource* resource, EPixelFormat format, uint32 flags, const FClearValueBinding& clearValue) const
+{
+	FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+	return DynamicRHI->RHICreateTexture2DFromResource(format, flags, clearValue, resource);
+}
+
+void VarjoCustomPresentD3D12::AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture)
+{
+	FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+	DynamicRHI->RHIAliasTextureResources(DestTexture, SrcTexture);
+}
+
+bool VarjoCustomPresentD3D12::CreateRenderTargetTexture(uint32 Index, uint32 NumSamples, FTexture2DRHIRef& OutTargetableTexture,
+	FTexture2DRHIRef& OutShaderResourceTexture)
+{
+	// The fallback copies with CopyResource, so it keeps a single-sampled target.
+	if (!m_nativeSwapChains)
+	{
+		const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+		const FIntPoint atlasSize = layout.GetAtlasSize();
+		FRHIResourceCreateInfo CreateInfo;
+		RHICreateTargetableShaderResource2D(atlasSize.X, atlasSize.Y, layout.GetColorPixelFormat(), 1, TexCreate_None, TexCreate_RenderTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
+
+		// Wrap the new target ahead of time so rebinding it later is only a lookup.
+		FTexture2DRHIRef renderTarget = OutTargetableTexture;
+		FRHICommandListExecutor::GetImmediateCommandList().EnqueueLambda([this, renderTarget](FRHICommandListImmediate&)
+		{
+			getWrappedTexture(renderTarget);
 		});
+		return true;
+	}
+
+	return VarjoCustomPresent::CreateRenderTargetTexture(Index, NumSamples, OutTargetableTexture, OutShaderResourceTexture);
+}
+
+FTexture2DRHIRef VarjoCustomPresentD3D12::createColorImageTexture(int32_t index) const
+{
+	ID3D12Resource* image = varjo_ToD3D12Texture(varjo_GetSwapChainImage(m_swapChain, index));
+	return createTexture(image, m_varjoHMD->GetAtlasLayout().GetColorPixelFormat(), TexCreate_ShaderResource | TexCreate_RenderTargetable, FClearValueBinding::Black);
+}
+
+varjo_TextureFormat VarjoCustomPresentD3D12::getEngineDepthFormat() const
+{
+	return GPixelFormats[PF_DepthStencil].PlatformFormat == DXGI_FORMAT_R24G8_TYPELESS ? varjo_DepthTextureFormat_D24_UNORM_S8_UINT : varjo_DepthTextureFormat_D32_FLOAT_S8_UINT;
+}
+
+varjo_SwapChain* VarjoCustomPresentD3D12::createDepthSwapChain(const varjo_SwapChainConfig2& config)
+{
+	// Blocks: the engine's depth target is created from the swap chain images right after this returns. Depth
+	// targets are only reallocated when depth submission is toggled, so the flush is rare.
+	varjo_SwapChain* swapChain = nullptr;
+	ExecuteOnRHIThread([this, config, &swapChain]() {
+		varjo_SwapChainConfig2 depthScConfig = config;
+		if (m_nativeSwapChains)
+		{
+			FD3D12DynamicRHI* DynamicRHI = static_cast<FD3D12DynamicRHI*>(GDynamicRHI);
+			swapChain = varjo_D3D12CreateSwapChain(m_session, DynamicRHI->RHIGetD3DCommandQueue(), &depthScConfig);
+		}
+		else
+		{
+			swapChain = varjo_D3D11CreateSwapChain(m_session, m_device, &depthScConfig);
+		}
 	});
+	return swapChain;
+}
 
-	InViewportRHI->SetCustomPresent(this);
+FTexture2DRHIRef VarjoCustomPresentD3D12::createDepthImageTexture(int32_t index, EPixelFormat format) const
+{
+	// Fallback images live on the D3D11On12 device and cannot be engine targets; depth is copied into them.
+	if (!m_nativeSwapChains)
+	{
+		return {};
+	}
+
+	ID3D12Resource* image = varjo_ToD3D12Texture(varjo_GetSwapChainImage(m_depthSwapChain, index));
+	return createTexture(image, format, TexCreate_ShaderResource | TexCreate_DepthStencilTargetable, FClearValueBinding::DepthFar);
 }
 
-bool VarjoCustomPresentD3D12::CreateRenderTargetTexture(FTexture2DRHIRef& OutTargetableTexture,
-	FTexture2DRHIRef& OutShaderResourceTexture)
+void VarjoCustomPresentD3D12::releaseDepthPipeline()
 {
-	FRHIResourceCreateInfo CreateInfo;
-	RHICreateTargetableShaderResource2D(4096, 3200, PF_B8G8R8A8, 1, TexCreate_None, TexCreate_RenderTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
-	return true;
+	// Blocks: queued frames still release their depth images into the swap chain, and the render thread must
+	// see it gone before it decides whether to create a new one for the next depth target.
+	ExecuteOnRHIThread([this]() {
+		VarjoCustomPresent::releaseDepthPipeline();
+	});
 }
 
 bool VarjoCustomPresentD3D12::CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture,
 	FTexture2DRHIRef& OutShaderResourceTexture)
 {
-	FRHIResourceCreateInfo CreateInfo;
-	CreateInfo.ClearValueBinding = FClearValueBinding(0.0f);
-	RHICreateTargetableShaderResource2D(4096, 3200, PF_DepthStencil, 1, TexCreate_None, TexCreate_DepthStencilTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
-	return true;
+	// The engine target is about to be replaced, drop the wrapper of the old one once the frames queued with it
+	// have been submitted.
+	FRHICommandListExecutor::GetImmediateCommandList().EnqueueLambda([this](FRHICommandListImmediate&)
+	{
+		if (m_wrappedDepthTexture != nullptr)
+		{
+			m_wrappedDepthTexture->Release();
+			m_wrappedDepthTexture = nullptr;
+		}
+	});
+
+	return VarjoCustomPresent::CreateDepthTargetTexture(OutTargetableTexture, OutShaderResourceTexture);
 }
 
+void VarjoCustomPresentD3D12::Shutdown()
+{
+	// Blocks: the wrappers belong to the D3D11On12 device and must be released before the session and the
+	// swap chains go away right after this.
+	ExecuteOnRHIThread([this]() {
+		if (m_wrappedDepthTexture != nullptr)
+		{
+			m_wrappedDepthTexture->Release();
+			m_wrappedDepthTexture = nullptr;
+		}
+		for (auto& entry : m_wrappedTextures)
+		{
+			entry.Value.wrapped->Release();
+		}
+		m_wrappedTextures.Empty();
+		m_texture = nullptr;
+	});
+
+	VarjoCustomPresent::Shutdown();
+}
@@ -2,11 +2,19 @@
 
 #pragma once
 
-#include "VarjoCustomPresent.h"
+#include "VarjoCustomPresentD3D11.h"
 
 #include <d3d12.h>
 #include <d3d11on12.h>
 
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+THIRD_PARTY_INCLUDES_START
+#include "Varjo_d3d12.h"
+THIRD_PARTY_INCLUDES_END
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
 class VarjoCustomPresentD3D12 : public VarjoCustomPresent
 {
 public:
@@ -16,13 +24,48 @@ public:
 	void varjoInit() override;
 	virtual void UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI);
 	virtual void varjoSubmit() override;
-	FTextureRHIRef CreateTexture(ID3D11Texture2D* d3dTexture) const override { return {}; };
-	void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) override {};
-	virtual bool CreateRenderTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override;
+	virtual void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) override;
+	virtual bool CreateRenderTargetTexture(uint32 Index, uint32 NumSamples, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override;
 	virtual bool CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override;
-	virtual void BeginRendering() override;
+	virtual void Shutdown() override;
+
+protected:
+	virtual FTexture2DRHIRef createColorImageTexture(int32_t index) const override;
+	virtual varjo_TextureFormat getEngineDepthFormat() const override;
+	virtual bool rendersIntoSwapChain() const override { return m_nativeSwapChains; }
+	virtual varjo_SwapChain* createDepthSwapChain(const varjo_SwapChainConfig2& config) override;
+	virtual FTexture2DRHIRef createDepthImageTexture(int32_t index, EPixelFormat format) const override;
+	virtual void releaseDepthPipeline() override;
 
 private:
-	ID3D11On12Device* m_d3d11On12Device;
-	ID3D12Resource* m_d3d12Texture{nullptr};
+	// Native path: swap chains on the engine's D3D12 queue, images used directly as engine targets.
+	bool initNativeSwapChains();
+	FTexture2DRHIRef createTexture(ID3D12Resource* resource, EPixelFormat format, uint32 flags, const FClearValueBinding& clearValue) const;
+
+	// Fallback path for runtimes without D3D12 swap chains: D3D11 swap chains on a D3D11On12 device,
+	// engine targets copied into them at submit.
+	bool initD3D11On12();
+	bool copyToSwapChain(varjo_SwapChain* swapChain, ID3D11Texture2D* source);
+	ID3D11Texture2D* getWrappedDepthTexture();
+	// RHI thread only.
+	ID3D11Texture2D* getWrappedTexture(const FTexture2DRHIRef& texture);
+	void releaseUnusedWrappedTextures();
+
+	bool m_nativeSwapChains = false;
+
+	struct FWrappedTexture
+	{
+		FTexture2DRHIRef engineTexture;
+		ID3D11Texture2D* wrapped;
+	};
+
+	ID3D11Device* m_device{nullptr};
+	ID3D11DeviceContext* m_deviceContext{nullptr};
+	ID3D11On12Device* m_d3d11On12Device{nullptr};
+	// Wrapper of the engine's current viewport target. RHI thread only.
+	ID3D11Texture2D* m_texture{nullptr};
+	// D3D11On12 wrappers of the engine's viewport targets, keyed by their D3D12 resource. RHI thread only.
+	TMap<ID3D12Resource*, FWrappedTexture> m_wrappedTextures;
+	// Engine scene depth wrapped for the D3D11On12 device on the fallback path. RHI thread only.
+	ID3D11Texture2D* m_wrappedDepthTexture{nullptr};
 };
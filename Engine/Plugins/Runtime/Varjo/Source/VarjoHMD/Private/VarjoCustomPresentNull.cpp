@@ -0,0 +1,34 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#include "VarjoCustomPresentNull.h"
+#include "VarjoHMD.h"
+
+VarjoCustomPresentNull::VarjoCustomPresentNull(class FVarjoHMD* varjoHMD) :
+	VarjoCustomPresent(varjoHMD)
+{
+}
+
+VarjoCustomPresentNull::~VarjoCustomPresentNull()
+{
+}
+
+void VarjoCustomPresentNull::varjoInit()
+{
+	// No swap chains: frames are submitted without layers and there is no depth to convert.
+	m_depthCopy = false;
+	m_frameInfo = varjo_CreateFrameInfo(m_session);
+
+	initViewports();
+	UE_LOG(LogHMD, Log, TEXT("Null RHI, running Varjo frames without rendering."));
+}
+
+void VarjoCustomPresentNull::varjoSubmit()
+{
+	if (!m_inFrame)
+	{
+		return;
+	}
+
+	// No images to release, end the frame without layers.
+	varjoEndFrame(false);
+}
@@ -0,0 +1,31 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#pragma once
+
+#include "VarjoCustomPresent.h"
+
+/**
+ * Bridge for the null RHI (-nullrhi). Runs the frame loop against the runtime - wait, pose and projection
+ * update, submit - without swap chains or GPU work. Nothing renders, so FVarjoHMD drives its frames from
+ * the game thread instead of the viewport.
+ */
+class VarjoCustomPresentNull : public VarjoCustomPresent
+{
+public:
+	VarjoCustomPresentNull(class FVarjoHMD* varjoHMD);
+	~VarjoCustomPresentNull() override;
+
+	void varjoInit() override;
+	virtual void varjoSubmit() override;
+	virtual void UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI) override {}
+	virtual void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) override {}
+	virtual bool CreateRenderTargetTexture(uint32 Index, uint32 NumSamples, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override { return false; }
+	virtual bool CreateDepthTargetTexture(FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture) override { return false; }
+
+protected:
+	virtual FTexture2DRHIRef createColorImageTexture(int32_t index) const override { return {}; }
+	virtual varjo_TextureFormat getEngineDepthFormat() const override { return varjo_DepthTextureFormat_D32_FLOAT_S8_UINT; }
+	virtual bool rendersIntoSwapChain() const override { return false; }
+	virtual varjo_SwapChain* createDepthSwapChain(const varjo_SwapChainConfig2& config) override { return nullptr; }
+	virtual FTexture2DRHIRef createDepthImageTexture(int32_t index, EPixelFormat format) const override { return {}; }
+};
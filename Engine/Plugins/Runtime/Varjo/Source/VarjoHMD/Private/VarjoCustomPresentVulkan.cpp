@@ -0,0 +1,131 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#ifdef VARJO_USE_VULKAN
+
+#include "VarjoCustomPresentVulkan.h"
+#include "VarjoHMD.h"
+#include "VulkanRHIPrivate.h"
+#include "XRThreadUtils.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+THIRD_PARTY_INCLUDES_START
+#include "Varjo_vk.h"
+THIRD_PARTY_INCLUDES_END
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+VarjoCustomPresentVulkan::VarjoCustomPresentVulkan(class FVarjoHMD* varjoHMD) :
+	VarjoCustomPresent(varjoHMD)
+{
+}
+
+VarjoCustomPresentVulkan::~VarjoCustomPresentVulkan()
+{
+}
+
+void VarjoCustomPresentVulkan::varjoInit()
+{
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	const FIntPoint atlasSize = layout.GetAtlasSize();
+
+	varjo_SwapChainConfig2 scConfig{ layout.GetColorFormat(), layout.GetNumberOfTextures(), atlasSize.X, atlasSize.Y, 1 };
+	m_swapChain = createSwapChain(scConfig);
+	if (m_swapChain == nullptr)
+	{
+		UE_LOG(LogHMD, Log, TEXT("Vulkan swap chain could not be created."));
+		return;
+	}
+
+	m_frameInfo = varjo_CreateFrameInfo(m_session);
+
+	m_textureCount = layout.GetNumberOfTextures();
+
+	initViewports();
+}
+
+varjo_SwapChain* VarjoCustomPresentVulkan::createSwapChain(const varjo_SwapChainConfig2& config) const
+{
+	varjo_SwapChainConfig2 scConfig = config;
+	varjo_SwapChain* swapChain = nullptr;
+	ExecuteOnRHIThread([this, &scConfig, &swapChain]() {
+		FVulkanDevice* device = static_cast<FVulkanDynamicRHI*>(GDynamicRHI)->GetDevice();
+		// The engine submits all graphics work to the first queue of the graphics family.
+		swapChain = varjo_VKCreateSwapChain(m_session, device->GetInstanceHandle(), device->GetGraphicsQueue()->GetFamilyIndex(), 0, &scConfig);
+	});
+	return swapChain;
+}
+
+void VarjoCustomPresentVulkan::varjoSubmit()
+{
+	if (!m_inFrame)
+	{
+		return;
+	}
+
+	// Submit the frame's rendering before the images are released. The swap chains live on the same queue, so
+	// queue order makes the compositor's reads wait for it without extra semaphores. The immediate context's
+	// command buffers belong to the thread executing RHI commands.
+	check(IsInRHIThread() || !IsRunningRHIInSeparateThread());
+	FVulkanDevice* device = static_cast<FVulkanDynamicRHI*>(GDynamicRHI)->GetDevice();
+	FVulkanCommandListContext& context = device->GetImmediateContext();
+	FVulkanCommandBufferManager* cmdBufferManager = context.GetCommandBufferManager();
+	FVulkanCmdBuffer* cmdBuffer = cmdBufferManager->GetActiveCmdBuffer();
+	if (cmdBuffer->HasBegun())
+	{
+		// A pass left open by SetRenderTargets is only closed by the next target change. End it the way the
+		// engine's own viewport present does, so the frame is never held back for it.
+		if (cmdBuffer->IsInsideRenderPass())
+		{
+			context.GetTransitionAndLayoutManager().EndEmulatedRenderPass(cmdBuffer);
+		}
+		cmdBufferManager->SubmitActiveCmdBuffer();
+		cmdBufferManager->PrepareForNewActiveCommandBuffer();
+	}
+
+	VarjoCustomPresent::varjoSubmit();
+}
+
+void VarjoCustomPresentVulkan::UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI)
+{
+	check(IsInGameThread());
+	check(InViewportRHI);
+
+	InViewportRHI->SetCustomPresent(this);
+}
+
+FTexture2DRHIRef VarjoCustomPresentVulkan::createColorImageTexture(int32_t index) const
+{
+	FVulkanDynamicRHI* DynamicRHI = static_cast<FVulkanDynamicRHI*>(GDynamicRHI);
+	const FVarjoAtlasLayout& layout = m_varjoHMD->GetAtlasLayout();
+	VkImage image = varjo_ToVkTexture(varjo_GetSwapChainImage(m_swapChain, index));
+	const uint32 TexCreateFlags = TexCreate_ShaderResource | TexCreate_RenderTargetable;
+	return DynamicRHI->RHICreateTexture2DFromResource(layout.GetColorPixelFormat(), layout.GetAtlasSize().X, layout.GetAtlasSize().Y, 1, 1, image, TexCreateFlags);
+}
+
+varjo_TextureFormat VarjoCustomPresentVulkan::getEngineDepthFormat() const
+{
+	return GPixelFormats[PF_DepthStencil].PlatformFormat == VK_FORMAT_D24_UNORM_S8_UINT ? varjo_DepthTextureFormat_D24_UNORM_S8_UINT : varjo_DepthTextureFormat_D32_FLOAT_S8_UINT;
+}
+
+varjo_SwapChain* VarjoCustomPresentVulkan::createDepthSwapChain(const varjo_SwapChainConfig2& config)
+{
+	return createSwapChain(config);
+}
+
+FTexture2DRHIRef VarjoCustomPresentVulkan::createDepthImageTexture(int32_t index, EPixelFormat format) const
+{
+	FVulkanDynamicRHI* DynamicRHI = static_cast<FVulkanDynamicRHI*>(GDynamicRHI);
+	const FIntPoint atlasSize = m_varjoHMD->GetAtlasLayout().GetAtlasSize();
+	VkImage image = varjo_ToVkTexture(varjo_GetSwapChainImage(m_depthSwapChain, index));
+	const uint32 TexCreateFlags = TexCreate_ShaderResource | TexCreate_DepthStencilTargetable;
+	return DynamicRHI->RHICreateTexture2DFromResource(format, atlasSize.X, atlasSize.Y, 1, 1, image, TexCreateFlags);
+}
+
+void VarjoCustomPresentVulkan::AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture)
+{
+	FVulkanDynamicRHI* DynamicRHI = static_cast<FVulkanDynamicRHI*>(GDynamicRHI);
+	DynamicRHI->RHIAliasTextureResources(DestTexture, SrcTexture);
+}
+
+#endif // VARJO_USE_VULKAN
@@ -0,0 +1,31 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#pragma once
+
+#ifdef VARJO_USE_VULKAN
+
+#include "VarjoCustomPresent.h"
+
+class VarjoCustomPresentVulkan : public VarjoCustomPresent
+{
+public:
+	VarjoCustomPresentVulkan(class FVarjoHMD* varjoHMD);
+	~VarjoCustomPresentVulkan() override;
+
+	void varjoInit() override;
+	virtual void UpdateViewport(const FViewport& Viewport, FRHIViewport* InViewportRHI);
+	virtual void varjoSubmit() override;
+	virtual void AliasTextureResources(FRHITexture* DestTexture, FRHITexture* SrcTexture) override;
+
+protected:
+	virtual FTexture2DRHIRef createColorImageTexture(int32_t index) const override;
+	virtual varjo_TextureFormat getEngineDepthFormat() const override;
+	virtual varjo_SwapChain* createDepthSwapChain(const varjo_SwapChainConfig2& config) override;
+	virtual FTexture2DRHIRef createDepthImageTexture(int32_t index, EPixelFormat format) const override;
+
+private:
+	// Swap chains are created on the engine's graphics queue so the runtime sees rendering in queue order.
+	varjo_SwapChain* createSwapChain(const varjo_SwapChainConfig2& config) const;
+};
+
+#endif // VARJO_USE_VULKAN
@@ -4,8 +4,80 @@
 #include "DynamicResolutionProxy.h"
 #include "DynamicResolutionState.h"
 #include "ScreenRendering.h"
-
-FVarjoDynamicResolutionDriver::FVarjoDynamicResolutionDriver(const FDynamicResolutionHeuristicProxy* InProxy, const FSceneViewFamily& InViewFamily)
+#include "VarjoAtlasLayout.h"
+#include "VarjoHMD_Types.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Misc/Paths.h"
+#include "RHI.h"
+
+static TAutoConsoleVariable<int32> CVarVarjoDynamicResGPUTiming(
+	TEXT("vr.Varjo.DynamicResGPUTiming"),
+	1,
+	TEXT("How GPU time is measured for Varjo dynamic resolution.\n")
+	TEXT("0: whole GPU frame time from the RHI, including compositor work and bubbles\n")
+	TEXT("1: timestamp queries around the frame and the dynamic resolution section, when the RHI supports them (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDynamicResController(
+	TEXT("vr.Varjo.DynamicResController"),
+	1,
+	TEXT("Controller choosing the dynamic resolution fraction.\n")
+	TEXT("0: engine heuristic, reacting to past frame times\n")
+	TEXT("1: Varjo controller, predicting the fraction that meets the compositor deadline (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResContextMin(
+	TEXT("vr.Varjo.DynamicResContextMin"),
+	0.5f,
+	TEXT("Lowest resolution fraction of the context views under dynamic resolution."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResContextMax(
+	TEXT("vr.Varjo.DynamicResContextMax"),
+	1.0f,
+	TEXT("Highest resolution fraction of the context views under dynamic resolution."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResFocusMin(
+	TEXT("vr.Varjo.DynamicResFocusMin"),
+	0.7f,
+	TEXT("Lowest resolution fraction of the focus views under dynamic resolution.\n")
+	TEXT("Focus views never go below the context views, so their rects stay clear of each other in the atlas."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResFocusMax(
+	TEXT("vr.Varjo.DynamicResFocusMax"),
+	1.0f,
+	TEXT("Highest resolution fraction of the focus views under dynamic resolution."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDynamicResFocusArea(
+	TEXT("vr.Varjo.DynamicResFocusArea"),
+	0,
+	TEXT("Narrow the focus views under load before lowering their resolution.\n")
+	TEXT("0: focus views keep the runtime's angular extent (default)\n")
+	TEXT("1: once the context views are at their lowest fraction, the focus views shrink around their center at full pixel density"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResFocusAreaMin(
+	TEXT("vr.Varjo.DynamicResFocusAreaMin"),
+	0.6f,
+	TEXT("Smallest angular extent of the focus views under vr.Varjo.DynamicResFocusArea, relative to the runtime's."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDynamicResWarmStart(
+	TEXT("vr.Varjo.DynamicResWarmStart"),
+	1,
+	TEXT("Remember the steady dynamic resolution state per map and GPU in Saved/Varjo/DynamicResolution.ini,\n")
+	TEXT("and start the controller from it on the next session instead of converging from the upper bound.\n")
+	TEXT("0: off\n")
+	TEXT("1: on (default)"),
+	ECVF_Default);
+
+// Focus area changes move the focus view rects; steps keep them from changing every frame.
+static const float FocusAreaScaleStep = 0.05f;
+
+FVarjoDynamicResolutionDriver::FVarjoDynamicResolutionDriver(const FVarjoDynamicResolutionStateProxy* InProxy, const FSceneViewFamily& InViewFamily)
 	: Proxy(InProxy)
 	, ViewFamily(InViewFamily)
 {
@@ -19,7 +91,7 @@ float FVarjoDynamicResolutionDriver::GetPrimaryResolutionFractionUpperBound() co
 		return 1.0f;
 	}
 
-	return Proxy->GetResolutionFractionUpperBound();
+	return Proxy->GetViewFractionUpperBound();
 }
 
 ISceneViewFamilyScreenPercentage* FVarjoDynamicResolutionDriver::Fork_GameThread(const class FSceneViewFamily& ForkedViewFamily) const
@@ -38,20 +110,30 @@ void FVarjoDynamicResolutionDriver::ComputePrimaryResolutionFractions_RenderThre
 		return;
 	}
 
-	float GlobalResolutionFraction = Proxy->QueryCurentFrameResolutionFraction_RenderThread();
+	float ContextFraction = 1.0f;
+	float FocusFraction = 1.0f;
+	Proxy->GetViewFractions_RenderThread(ContextFraction, FocusFraction);
 
+	// Views 0 and 1 are the context views, 2 and 3 the focus views.
 	for (int32 i = 0; i < OutViewScreenPercentageConfigs.Num(); i++)
 	{
-		OutViewScreenPercentageConfigs[i].PrimaryResolutionFraction = GlobalResolutionFraction;
+		OutViewScreenPercentageConfigs[i].PrimaryResolutionFraction = i < 2 ? ContextFraction : FocusFraction;
 	}
 }
 
-FVarjoDynamicResolutionStateProxy::FVarjoDynamicResolutionStateProxy()
+FVarjoDynamicResolutionStateProxy::FVarjoDynamicResolutionStateProxy(int64 InContextPixels, int64 InFocusPixels)
+	: ContextPixels(float(FMath::Max<int64>(InContextPixels, 1)))
+	, FocusPixels(float(FMath::Max<int64>(InFocusPixels, 1)))
 {
 	check(IsInGameThread());
 	InFlightFrames.SetNum(4);
 	CurrentFrameInFlightIndex = -1;
 	bUseTimeQueriesThisFrame = false;
+	PrevFrameResolutionFraction = 1.0f;
+	PrevFrameContextFraction = 1.0f;
+	PrevFrameFocusFraction = 1.0f;
+	FocusAreaScale = 1.0f;
+	WarmStartPeriodMs = 0.0f;
 }
 
 void FVarjoDynamicResolutionStateProxy::Reset()
@@ -60,6 +142,11 @@ void FVarjoDynamicResolutionStateProxy::Reset()
 
 	// Reset heuristic.
 	Heuristic.Reset_RenderThread();
+	ResetController();
+	Calibration.Cancel();
+	FocusAreaScale = 1.0f;
+	PrevFrameResolutionFraction = Controller.GetFraction();
+	GetViewFractions_RenderThread(PrevFrameContextFraction, PrevFrameFocusFraction);
 
 	// Set invalid heuristic's entry id on all inflight frames.
 	for (auto& InFlightFrame : InFlightFrames)
@@ -67,7 +154,204 @@ void FVarjoDynamicResolutionStateProxy::Reset()
 		InFlightFrame.HeuristicHistoryEntry = FDynamicResolutionHeuristicProxy::kInvalidEntryId;
 	}
 
-	RenderQueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+	// Queries of frames still in flight belong to the pool, keep it.
+	if (!RenderQueryPool.IsValid())
+	{
+		RenderQueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+	}
+}
+
+float FVarjoDynamicResolutionStateProxy::GetViewFractionUpperBound() const
+{
+	return FMath::Min(FMath::Max(CVarVarjoDynamicResContextMax.GetValueOnAnyThread(), CVarVarjoDynamicResFocusMax.GetValueOnAnyThread()),
+		Heuristic.GetResolutionFractionUpperBound());
+}
+
+void FVarjoDynamicResolutionStateProxy::GetViewFractionBounds_RenderThread(float& OutContextMin, float& OutContextMax, float& OutFocusMin, float& OutFocusMax) const
+{
+	const float UpperBound = Heuristic.GetResolutionFractionUpperBound();
+	OutContextMax = FMath::Clamp(CVarVarjoDynamicResContextMax.GetValueOnRenderThread(), 0.1f, UpperBound);
+	OutContextMin = FMath::Clamp(CVarVarjoDynamicResContextMin.GetValueOnRenderThread(), 0.1f, OutContextMax);
+	OutFocusMax = FMath::Clamp(CVarVarjoDynamicResFocusMax.GetValueOnRenderThread(), 0.1f, UpperBound);
+	OutFocusMin = FMath::Clamp(CVarVarjoDynamicResFocusMin.GetValueOnRenderThread(), 0.1f, OutFocusMax);
+}
+
+void FVarjoDynamicResolutionStateProxy::GetViewFractions_RenderThread(float& OutContextFraction, float& OutFocusFraction) const
+{
+	check(IsInRenderingThread());
+
+	if (Calibration.IsRunning())
+	{
+		Calibration.GetViewFractions(OutContextFraction, OutFocusFraction);
+		return;
+	}
+
+	float ContextMin, ContextMax, FocusMin, FocusMax;
+	GetViewFractionBounds_RenderThread(ContextMin, ContextMax, FocusMin, FocusMax);
+
+	// Only the context views are rendered; the controller's fraction is measured on them alone. The focus fraction
+	// only matters for the frame or two in flight while the view count changes.
+	if (CVarVarjoDynamicResController.GetValueOnRenderThread() != 0 && Controller.IsDualView())
+	{
+		OutContextFraction = FMath::Clamp(Controller.GetFraction(), ContextMin, ContextMax);
+		OutFocusFraction = FMath::Max(FocusMin, OutContextFraction);
+		return;
+	}
+
+	// Pixels the controller would render with one fraction on all four views.
+	const float Budget = FMath::Square(GetResolutionFraction_RenderThread()) * (ContextPixels + FocusPixels);
+	const float FocusAreaPixels = FMath::Square(FocusAreaScale) * FocusPixels;
+
+	OutContextFraction = FMath::Clamp(FMath::Sqrt(FMath::Max(Budget - FMath::Square(FocusMax) * FocusAreaPixels, 0.0f) / ContextPixels), ContextMin, ContextMax);
+	OutFocusFraction = FMath::Clamp(FMath::Sqrt(FMath::Max(Budget - FMath::Square(OutContextFraction) * ContextPixels, 0.0f) / FocusAreaPixels), FocusMin, FocusMax);
+
+	// Focus views are placed below the context views; a smaller fraction would scale them into the context rects.
+	OutFocusFraction = FMath::Max(OutFocusFraction, OutContextFraction);
+}
+
+float FVarjoDynamicResolutionStateProxy::GetResolutionFraction_RenderThread() const
+{
+	check(IsInRenderingThread());
+	return CVarVarjoDynamicResController.GetValueOnRenderThread() != 0 ? Controller.GetFraction() : Heuristic.QueryCurentFrameResolutionFraction_RenderThread();
+}
+
+float FVarjoDynamicResolutionStateProxy::GetResolutionFractionApproximation_GameThread() const
+{
+	// The controller's fraction is read without synchronization; like the heuristic's, it is only an approximation here.
+	return CVarVarjoDynamicResController.GetValueOnGameThread() != 0 ? Controller.GetFraction() : Heuristic.GetResolutionFractionApproximation_GameThread();
+}
+
+void FVarjoDynamicResolutionStateProxy::ResetController()
+{
+	const float UpperBound = Heuristic.GetResolutionFractionUpperBound();
+	WarmStartPeriodMs = 0.0f;
+	if (WarmStart.IsValid())
+	{
+		// The cached fraction fit the budget of the period it was measured at. Pixels, and so GPU time, scale with
+		// the square of the fraction; move it by the ratio of the periods.
+		const float PeriodMs = Controller.GetFramePeriodMs();
+		const float PeriodRatio = WarmStart.FramePeriodMs > 0.0f ? PeriodMs / WarmStart.FramePeriodMs : 1.0f;
+		const float Fraction = FMath::Min(WarmStart.Fraction * FMath::Sqrt(PeriodRatio), UpperBound);
+		Controller.Seed(Fraction, WarmStart.GPUTimeMs * FMath::Square(Fraction / WarmStart.Fraction));
+		WarmStartPeriodMs = Controller.HasFramePeriod() ? 0.0f : PeriodMs;
+	}
+	else
+	{
+		Controller.Reset(UpperBound);
+	}
+}
+
+void FVarjoDynamicResolutionStateProxy::SetWarmStart_RenderThread(const FVarjoDynamicResolutionWarmStart& InWarmStart)
+{
+	check(IsInRenderingThread());
+
+	WarmStart = InWarmStart;
+	ResetController();
+	PrevFrameResolutionFraction = Controller.GetFraction();
+	{
+		FScopeLock Lock(&ConvergedStateLock);
+		ConvergedState = FVarjoDynamicResolutionWarmStart();
+	}
+}
+
+FVarjoDynamicResolutionWarmStart FVarjoDynamicResolutionStateProxy::GetConvergedState() const
+{
+	FScopeLock Lock(&ConvergedStateLock);
+	return ConvergedState;
+}
+
+void FVarjoDynamicResolutionStateProxy::UpdateFocusAreaScale_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	if (CVarVarjoDynamicResFocusArea.GetValueOnRenderThread() == 0 || Calibration.IsRunning()
+		|| (CVarVarjoDynamicResController.GetValueOnRenderThread() != 0 && Controller.IsDualView()))
+	{
+		FocusAreaScale = 1.0f;
+		return;
+	}
+
+	float ContextMin, ContextMax, FocusMin, FocusMax;
+	GetViewFractionBounds_RenderThread(ContextMin, ContextMax, FocusMin, FocusMax);
+
+	// Narrowing starts where the context views would go below their minimum, before the focus fraction is lowered.
+	const float Budget = FMath::Square(GetResolutionFraction_RenderThread()) * (ContextPixels + FocusPixels);
+	const float FocusBudget = FMath::Max(Budget - FMath::Square(ContextMin) * ContextPixels, 0.0f);
+	const float Scale = FMath::Sqrt(FocusBudget / (FMath::Square(FocusMax) * FocusPixels));
+	const float MinScale = FMath::Clamp(CVarVarjoDynamicResFocusAreaMin.GetValueOnRenderThread(), 0.25f, 1.0f);
+	FocusAreaScale = FMath::Clamp(FMath::FloorToFloat(Scale / FocusAreaScaleStep) * FocusAreaScaleStep, MinScale, 1.0f);
+}
+
+float FVarjoDynamicResolutionStateProxy::GetFocusAreaScale_GameThread() const
+{
+	// Read without synchronization like the fraction.
+	return FocusAreaScale;
+}
+
+bool FVarjoDynamicResolutionStateProxy::IsDualView_GameThread() const
+{
+	// Read without synchronization like the fraction; the view count follows a frame late at worst. The calibration
+	// sweep measures the focus views, so they are rendered while it is active.
+	return CVarVarjoDynamicResController.GetValueOnGameThread() != 0 && Controller.IsDualView() && !Calibration.IsActive();
+}
+
+void FVarjoDynamicResolutionStateProxy::SetFramePeriodMs_RenderThread(float PeriodMs)
+{
+	check(IsInRenderingThread());
+	Controller.SetFramePeriodMs(PeriodMs);
+
+	// The warm start was scaled to the default period before the compositor's was measured.
+	if (WarmStartPeriodMs > 0.0f && PeriodMs > 0.0f)
+	{
+		if (FMath::Abs(PeriodMs - WarmStartPeriodMs) > WarmStartPeriodMs * 0.1f)
+		{
+			ResetController();
+			PrevFrameResolutionFraction = Controller.GetFraction();
+		}
+		WarmStartPeriodMs = 0.0f;
+	}
+}
+
+void FVarjoDynamicResolutionStateProxy::StartCalibration_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	// The sweep fits the cost of the focus views, and the controller gets no samples to restore them while it runs.
+	Controller.ClearDualView();
+
+	float ContextMin, ContextMax, FocusMin, FocusMax;
+	GetViewFractionBounds_RenderThread(ContextMin, ContextMax, FocusMin, FocusMax);
+	Calibration.Start(ContextMax, FocusMax, Controller.GetFramePeriodMs(),
+		GSupportsTimestampRenderQueries && CVarVarjoDynamicResGPUTiming.GetValueOnRenderThread() == 1);
+}
+
+void FVarjoDynamicResolutionStateProxy::CancelCalibration_RenderThread()
+{
+	check(IsInRenderingThread());
+	Calibration.Cancel();
+}
+
+void FVarjoDynamicResolutionStateProxy::AddFrameTimings(float SampleFraction, float ContextFraction, float FocusFraction, float TotalFrameGPUTimeMs, float DynamicResolutionGPUTimeMs)
+{
+	// The sweep decides the fractions while it runs; the controller resumes from where it was.
+	if (Calibration.IsRunning())
+	{
+		Calibration.AddFrameTimings(ContextFraction, FocusFraction, TotalFrameGPUTimeMs, DynamicResolutionGPUTimeMs);
+		return;
+	}
+
+	static const auto CVarMinScreenPercentage = IConsoleManager::Get().FindTConsoleVariableDataFloat(TEXT("r.DynamicRes.MinScreenPercentage"));
+	const float MaxFraction = Heuristic.GetResolutionFractionUpperBound();
+	const float MinFraction = FMath::Min(CVarMinScreenPercentage ? CVarMinScreenPercentage->GetValueOnRenderThread() / 100.0f : 0.5f, MaxFraction);
+	Controller.AddFrameTimings(SampleFraction, TotalFrameGPUTimeMs, DynamicResolutionGPUTimeMs, MinFraction, MaxFraction);
+
+	if (Controller.IsConverged())
+	{
+		FScopeLock Lock(&ConvergedStateLock);
+		ConvergedState.Fraction = Controller.GetFraction();
+		ConvergedState.GPUTimeMs = Controller.GetMedianGPUTimeMs();
+		ConvergedState.FramePeriodMs = Controller.GetFramePeriodMs();
+	}
 }
 
 void FVarjoDynamicResolutionStateProxy::BeginFrame(FRHICommandList& RHICmdList, float PrevGameThreadTimeMs)
@@ -77,6 +361,34 @@ void FVarjoDynamicResolutionStateProxy::BeginFrame(FRHICommandList& RHICmdList,
 	// Query render thread time Ms.
 	float PrevRenderThreadTimeMs = FPlatformTime::ToMilliseconds(GRenderThreadTime);
 
+	bUseTimeQueriesThisFrame = GSupportsTimestampRenderQueries && CVarVarjoDynamicResGPUTiming.GetValueOnRenderThread() == 1;
+
+	UpdateFocusAreaScale_RenderThread();
+
+	if (bUseTimeQueriesThisFrame)
+	{
+		if (!RenderQueryPool.IsValid())
+		{
+			RenderQueryPool = RHICreateRenderQueryPool(RQT_AbsoluteTime);
+		}
+
+		// Hand over the frames whose queries have landed, without waiting on the GPU.
+		HandLandedQueriesToHeuristic(/* bWait = */ false);
+
+		FindNewInFlightIndex();
+
+		InFlightFrameQueries& InFlightFrame = InFlightFrames[CurrentFrameInFlightIndex];
+		InFlightFrame.BeginFrameQuery = RenderQueryPool->AllocateQuery();
+		RHICmdList.EndRenderQuery(InFlightFrame.BeginFrameQuery.GetQuery());
+
+		// GPU timings are committed to this entry once the frame's queries land.
+		InFlightFrame.HeuristicHistoryEntry = Heuristic.CreateNewPreviousFrameTimings_RenderThread(
+			PrevGameThreadTimeMs, PrevRenderThreadTimeMs);
+		InFlightFrame.ResolutionFraction = GetResolutionFraction_RenderThread();
+		GetViewFractions_RenderThread(InFlightFrame.ContextFraction, InFlightFrame.FocusFraction);
+		return;
+	}
+
 	// If RHI does not support GPU busy time queries, fall back to what stat unit does.
 	float PrevFrameGPUTimeMs = FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles());
 
@@ -90,6 +402,10 @@ void FVarjoDynamicResolutionStateProxy::BeginFrame(FRHICommandList& RHICmdList,
 
 	Heuristic.RefreshCurentFrameResolutionFraction_RenderThread();
 
+	AddFrameTimings(PrevFrameResolutionFraction, PrevFrameContextFraction, PrevFrameFocusFraction, PrevFrameGPUTimeMs, PrevFrameGPUTimeMs);
+	PrevFrameResolutionFraction = GetResolutionFraction_RenderThread();
+	GetViewFractions_RenderThread(PrevFrameContextFraction, PrevFrameFocusFraction);
+
 	// Set a non insane value for internal checks to pass as if GRHISupportsGPUBusyTimeQueries == true.
 	CurrentFrameInFlightIndex = 0;
 }
@@ -197,6 +513,10 @@ void FVarjoDynamicResolutionStateProxy::HandLandedQueriesToHeuristic(bool bWait)
 				/* DynamicResolutionGPUBusyTimeMs = */ float(EndDynamicResolutionResult - BeginDynamicResolutionResult) / 1000.0f,
 				/* bGPUTimingsHaveCPUBubbles = */ !GRHISupportsGPUTimestampBubblesRemoval);
 
+			AddFrameTimings(InFlightFrame.ResolutionFraction, InFlightFrame.ContextFraction, InFlightFrame.FocusFraction,
+				float(EndFrameResult - BeginFrameResult) / 1000.0f,
+				float(EndDynamicResolutionResult - BeginDynamicResolutionResult) / 1000.0f);
+
 			// Reset this in-flight frame queries to be reused.
 			InFlightFrame = InFlightFrameQueries();
 
@@ -234,8 +554,59 @@ void FVarjoDynamicResolutionStateProxy::FindNewInFlightIndex()
 	}
 }
 
-FVarjoDynamicResolutionState::FVarjoDynamicResolutionState()
-	: Proxy(new FVarjoDynamicResolutionStateProxy())
+static FString GetWarmStartCachePath()
+{
+	return FPaths::ProjectSavedDir() / TEXT("Varjo") / TEXT("DynamicResolution.ini");
+}
+
+static bool ReadWarmStartValue(const FConfigFile& Cache, const FString& Section, const TCHAR* Key, float& OutValue)
+{
+	FString Value;
+	if (!Cache.GetString(*Section, Key, Value))
+	{
+		return false;
+	}
+	OutValue = FCString::Atof(*Value);
+	return true;
+}
+
+static FVarjoDynamicResolutionWarmStart LoadWarmStart(const FString& Section)
+{
+	FConfigFile Cache;
+	Cache.Read(GetWarmStartCachePath());
+
+	FVarjoDynamicResolutionWarmStart WarmStart;
+	if (!ReadWarmStartValue(Cache, Section, TEXT("Fraction"), WarmStart.Fraction)
+		|| !ReadWarmStartValue(Cache, Section, TEXT("GPUTimeMs"), WarmStart.GPUTimeMs)
+		|| !ReadWarmStartValue(Cache, Section, TEXT("FramePeriodMs"), WarmStart.FramePeriodMs)
+		|| WarmStart.Fraction > 1.0f)
+	{
+		return FVarjoDynamicResolutionWarmStart();
+	}
+	return WarmStart;
+}
+
+static void StoreWarmStart(const FString& Section, const FVarjoDynamicResolutionWarmStart& WarmStart)
+{
+	const FString CachePath = GetWarmStartCachePath();
+	FConfigFile Cache;
+	Cache.Read(CachePath);
+	Cache.SetString(*Section, TEXT("Fraction"), *FString::SanitizeFloat(WarmStart.Fraction));
+	Cache.SetString(*Section, TEXT("GPUTimeMs"), *FString::SanitizeFloat(WarmStart.GPUTimeMs));
+	Cache.SetString(*Section, TEXT("FramePeriodMs"), *FString::SanitizeFloat(WarmStart.FramePeriodMs));
+	if (!Cache.Write(CachePath))
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Could not write the dynamic resolution warm start cache %s."), *CachePath);
+	}
+}
+
+static int64 GetViewPixels(const FVarjoAtlasLayout& Layout, int32 FirstView)
+{
+	return int64(Layout.GetViewRect(FirstView).Area()) + int64(Layout.GetViewRect(FirstView + 1).Area());
+}
+
+FVarjoDynamicResolutionState::FVarjoDynamicResolutionState(const FVarjoAtlasLayout& Layout)
+	: Proxy(new FVarjoDynamicResolutionStateProxy(GetViewPixels(Layout, 0), GetViewPixels(Layout, 2)))
 {
 	check(IsInGameThread());
 	bIsEnabled = false;
@@ -276,6 +647,17 @@ void FVarjoDynamicResolutionState::ResetHistory()
 void FVarjoDynamicResolutionState::SetEnabled(bool bEnable)
 {
 	check(IsInGameThread());
+
+	// Frames are not measured while disabled; a sweep would never finish.
+	if (!bEnable && bIsEnabled && IsCalibrating())
+	{
+		FVarjoDynamicResolutionStateProxy* P = Proxy;
+		ENQUEUE_RENDER_COMMAND(DynamicResolutionCancelCalibration)(
+			[P](class FRHICommandList&)
+		{
+			P->CancelCalibration_RenderThread();
+		});
+	}
 	bIsEnabled = bEnable;
 }
 
@@ -288,7 +670,7 @@ bool FVarjoDynamicResolutionState::IsEnabled() const
 float FVarjoDynamicResolutionState::GetResolutionFractionApproximation() const
 {
 	check(IsInGameThread());
-	return Proxy->Heuristic.GetResolutionFractionApproximation_GameThread();
+	return Proxy->GetResolutionFractionApproximation_GameThread();
 }
 
 float FVarjoDynamicResolutionState::GetResolutionFractionUpperBound() const
@@ -300,7 +682,102 @@ float FVarjoDynamicResolutionState::GetResolutionFractionUpperBound() const
 float FVarjoDynamicResolutionState::GetResolutionFraction() const
 {
 	check(IsInRenderingThread());
-	return Proxy->Heuristic.QueryCurentFrameResolutionFraction_RenderThread();
+	return Proxy->GetResolutionFraction_RenderThread();
+}
+
+void FVarjoDynamicResolutionState::SetFramePeriodMs(float PeriodMs)
+{
+	check(IsInRenderingThread());
+	Proxy->SetFramePeriodMs_RenderThread(PeriodMs);
+}
+
+bool FVarjoDynamicResolutionState::StartCalibration()
+{
+	check(IsInGameThread());
+
+	if (!bIsEnabled)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Dynamic resolution calibration needs dynamic resolution to be enabled (r.DynamicRes.OperationMode)."));
+		return false;
+	}
+
+	if (!Proxy->Calibration.Activate())
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Dynamic resolution calibration is already running."));
+		return false;
+	}
+
+	FVarjoDynamicResolutionStateProxy* P = Proxy;
+	ENQUEUE_RENDER_COMMAND(DynamicResolutionStartCalibration)(
+		[P](class FRHICommandList&)
+	{
+		P->StartCalibration_RenderThread();
+	});
+	return true;
+}
+
+bool FVarjoDynamicResolutionState::IsCalibrating() const
+{
+	return Proxy->Calibration.IsActive();
+}
+
+float FVarjoDynamicResolutionState::GetFocusAreaScale() const
+{
+	check(IsInGameThread());
+	return bIsEnabled ? Proxy->GetFocusAreaScale_GameThread() : 1.0f;
+}
+
+void FVarjoDynamicResolutionState::SetWarmStartMap(const FString& MapName)
+{
+	check(IsInGameThread());
+
+	SaveWarmStart();
+	if (CVarVarjoDynamicResWarmStart.GetValueOnGameThread() == 0)
+	{
+		WarmStartSection.Empty();
+		return;
+	}
+
+	// Section names cannot hold brackets; map package paths and adapter names rarely do.
+	WarmStartSection = FString::Printf(TEXT("%s %s %04x"), *MapName, *GRHIAdapterName, GRHIDeviceId).Replace(TEXT("["), TEXT("(")).Replace(TEXT("]"), TEXT(")"));
+	const FVarjoDynamicResolutionWarmStart WarmStart = LoadWarmStart(WarmStartSection);
+	UE_CLOG(WarmStart.IsValid(), LogVarjoHMD, Log, TEXT("Dynamic resolution warm start for %s: fraction %.3f, GPU %.2f ms at %.2f ms period."),
+		*WarmStartSection, WarmStart.Fraction, WarmStart.GPUTimeMs, WarmStart.FramePeriodMs);
+
+	FVarjoDynamicResolutionStateProxy* P = Proxy;
+	ENQUEUE_RENDER_COMMAND(DynamicResolutionSetWarmStart)(
+		[P, WarmStart](class FRHICommandList&)
+	{
+		P->SetWarmStart_RenderThread(WarmStart);
+	});
+}
+
+void FVarjoDynamicResolutionState::SaveWarmStart()
+{
+	check(IsInGameThread());
+
+	if (WarmStartSection.IsEmpty())
+	{
+		return;
+	}
+
+	const FVarjoDynamicResolutionWarmStart Converged = Proxy->GetConvergedState();
+	if (Converged.IsValid())
+	{
+		StoreWarmStart(WarmStartSection, Converged);
+	}
+}
+
+bool FVarjoDynamicResolutionState::IsDualView() const
+{
+	check(IsInGameThread());
+	return bIsEnabled && Proxy->IsDualView_GameThread();
+}
+
+void FVarjoDynamicResolutionState::GetViewFractions(float& OutContextFraction, float& OutFocusFraction) const
+{
+	check(IsInRenderingThread());
+	Proxy->GetViewFractions_RenderThread(OutContextFraction, OutFocusFraction);
 }
 
 void FVarjoDynamicResolutionState::ProcessEvent(EDynamicResolutionStateEvent Event)
@@ -355,6 +832,6 @@ void FVarjoDynamicResolutionState::SetupMainViewFamily(class FSceneViewFamily& V
 
 	if (bIsEnabled)
 	{
-		ViewFamily.SetScreenPercentageInterface(new FVarjoDynamicResolutionDriver(&Proxy->Heuristic, ViewFamily));
+		ViewFamily.SetScreenPercentageInterface(new FVarjoDynamicResolutionDriver(Proxy, ViewFamily));
 	}
 }
@@ -5,33 +5,62 @@
 #include "DynamicResolutionProxy.h"
 #include "DynamicResolutionState.h"
 #include "SceneView.h"
+#include "VarjoDynamicResolutionCalibration.h"
+#include "VarjoDynamicResolutionController.h"
 
 class FVarjoDynamicResolutionDriver : public ISceneViewFamilyScreenPercentage
 {
 public:
 
-	FVarjoDynamicResolutionDriver(const FDynamicResolutionHeuristicProxy* InProxy, const FSceneViewFamily& InViewFamily);
+	FVarjoDynamicResolutionDriver(const class FVarjoDynamicResolutionStateProxy* InProxy, const FSceneViewFamily& InViewFamily);
 
 	virtual float GetPrimaryResolutionFractionUpperBound() const override;
 	virtual ISceneViewFamilyScreenPercentage* Fork_GameThread(const class FSceneViewFamily& ForkedViewFamily) const override;
 	virtual void ComputePrimaryResolutionFractions_RenderThread(TArray<FSceneViewScreenPercentageConfig>& OutViewScreenPercentageConfigs) const override;
 
 private:
-	const FDynamicResolutionHeuristicProxy* Proxy;
+	const class FVarjoDynamicResolutionStateProxy* Proxy;
 	const FSceneViewFamily& ViewFamily;
 };
 
+/** Steady controller state of one map on one GPU, kept between sessions to start close to it. */
+struct FVarjoDynamicResolutionWarmStart
+{
+	float Fraction = 0.0f;
+	float GPUTimeMs = 0.0f;
+	float FramePeriodMs = 0.0f;
+
+	bool IsValid() const { return Fraction > 0.0f && GPUTimeMs > 0.0f; }
+};
+
 class FVarjoDynamicResolutionStateProxy
 {
 public:
-	FVarjoDynamicResolutionStateProxy();
+	FVarjoDynamicResolutionStateProxy(int64 InContextPixels, int64 InFocusPixels);
 
 	void Reset();
+	// Splits the heuristic's uniform fraction into context and focus view fractions with the same pixel cost.
+	// Context views are reduced first; focus views only once the context views are at their minimum.
+	void GetViewFractions_RenderThread(float& OutContextFraction, float& OutFocusFraction) const;
+	float GetViewFractionUpperBound() const;
+	float GetResolutionFraction_RenderThread() const;
+	float GetResolutionFractionApproximation_GameThread() const;
+	// True while the controller asks for only the context views to be rendered.
+	bool IsDualView_GameThread() const;
+	float GetFocusAreaScale_GameThread() const;
+	void SetFramePeriodMs_RenderThread(float PeriodMs);
+	void StartCalibration_RenderThread();
+	// Seeds the controller, now and on every reset, until replaced. An invalid warm start goes back to the upper bound.
+	void SetWarmStart_RenderThread(const FVarjoDynamicResolutionWarmStart& InWarmStart);
+	// Last steady state of the controller since the warm start was set.
+	FVarjoDynamicResolutionWarmStart GetConvergedState() const;
+	void CancelCalibration_RenderThread();
 	void BeginFrame(FRHICommandList& RHICmdList, float PrevGameThreadTimeMs);
 	void ProcessEvent(FRHICommandList& RHICmdList, EDynamicResolutionStateEvent Event);
 	void Finish();
 
 	FDynamicResolutionHeuristicProxy Heuristic;
+	FVarjoDynamicResolutionCalibration Calibration;
 
 private:
 	struct InFlightFrameQueries
@@ -42,24 +71,53 @@ private:
 		FRHIPooledRenderQuery EndFrameQuery;
 
 		uint64 HeuristicHistoryEntry;
+		// Fractions the frame was rendered at, for the controller's model and calibration.
+		float ResolutionFraction;
+		float ContextFraction;
+		float FocusFraction;
 
 		InFlightFrameQueries()
 			: HeuristicHistoryEntry(FDynamicResolutionHeuristicProxy::kInvalidEntryId)
+			, ResolutionFraction(1.0f)
+			, ContextFraction(1.0f)
+			, FocusFraction(1.0f)
 		{ }
 	};
 
+	// Full-resolution pixel counts of both context views and both focus views.
+	const float ContextPixels;
+	const float FocusPixels;
+
+	FVarjoDynamicResolutionController Controller;
+	// Angular extent of the focus views, narrowed once the context views are at their minimum.
+	float FocusAreaScale;
+	FVarjoDynamicResolutionWarmStart WarmStart;
+	// Default period the warm start was scaled to while the compositor's is not measured yet, otherwise 0.
+	float WarmStartPeriodMs;
+	FVarjoDynamicResolutionWarmStart ConvergedState;
+	mutable FCriticalSection ConvergedStateLock;
+	// Fractions of the previous frame, measured through frame cycles when timestamp queries are not used.
+	float PrevFrameResolutionFraction;
+	float PrevFrameContextFraction;
+	float PrevFrameFocusFraction;
+
 	FRenderQueryPoolRHIRef RenderQueryPool;
 	TArray<InFlightFrameQueries> InFlightFrames;
 	int32 CurrentFrameInFlightIndex;
 	bool bUseTimeQueriesThisFrame;
 	void HandLandedQueriesToHeuristic(bool bWait);
 	void FindNewInFlightIndex();
+	void UpdateFocusAreaScale_RenderThread();
+	void ResetController();
+	void GetViewFractionBounds_RenderThread(float& OutContextMin, float& OutContextMax, float& OutFocusMin, float& OutFocusMax) const;
+	// Hands the timings of a measured frame to the running calibration, or to the controller.
+	void AddFrameTimings(float SampleFraction, float ContextFraction, float FocusFraction, float TotalFrameGPUTimeMs, float DynamicResolutionGPUTimeMs);
 };
 
 class FVarjoDynamicResolutionState : public IDynamicResolutionState
 {
 public:
-	FVarjoDynamicResolutionState();
+	FVarjoDynamicResolutionState(const class FVarjoAtlasLayout& Layout);
 	~FVarjoDynamicResolutionState() override;
 
 	virtual bool IsSupported() const override;
@@ -69,11 +127,24 @@ public:
 	virtual float GetResolutionFractionApproximation() const override;
 	virtual float GetResolutionFractionUpperBound() const override;
 	float GetResolutionFraction() const;
+	void GetViewFractions(float& OutContextFraction, float& OutFocusFraction) const;
+	void SetFramePeriodMs(float PeriodMs);
+	// Starts a calibration sweep of the view fractions. Returns false if dynamic resolution is off or a sweep is running.
+	bool StartCalibration();
+	bool IsCalibrating() const;
+	bool IsDualView() const;
+	float GetFocusAreaScale() const;
+	// Keys the warm start cache by map and GPU: saves the steady state reached on the previous map and seeds the
+	// controller from the one cached for the new map.
+	void SetWarmStartMap(const FString& MapName);
+	void SaveWarmStart();
 	virtual void ProcessEvent(EDynamicResolutionStateEvent Event) override;
 	virtual void SetupMainViewFamily(class FSceneViewFamily& ViewFamily) override;
 
 private:
 	FVarjoDynamicResolutionStateProxy * const Proxy;
+	// Warm start cache section of the current map and GPU.
+	FString WarmStartSection;
 	bool bIsEnabled;
 	bool bRecordThisFrame;
 };
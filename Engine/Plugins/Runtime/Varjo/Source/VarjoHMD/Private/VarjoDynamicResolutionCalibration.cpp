@@ -0,0 +1,259 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#include "VarjoDynamicResolutionCalibration.h"
+#include "VarjoHMD.h"
+#include "Async/Async.h"
+#include "Misc/ConfigCacheIni.h"
+
+static TAutoConsoleVariable<int32> CVarVarjoDynamicResCalibrationFrames(
+	TEXT("vr.Varjo.DynamicResCalibrationFrames"),
+	45,
+	TEXT("Frames measured at each step of the dynamic resolution calibration sweep."),
+	ECVF_RenderThreadSafe);
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("DynRes Calibration Step"), STAT_VarjoDynRes_CalibrationStep, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Calibration Fixed Cost (ms)"), STAT_VarjoDynRes_CalibrationFixedCost, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Calibration Context Cost (ms)"), STAT_VarjoDynRes_CalibrationContextCost, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Calibration Focus Cost (ms)"), STAT_VarjoDynRes_CalibrationFocusCost, STATGROUP_Varjo);
+
+// Lowest fraction rendered by the sweep.
+static const float SweepFloor = 0.4f;
+// Points swept per view class, including the upper bound.
+static const int32 SweepPoints = 4;
+// Frames skipped after a step change, while temporal effects settle.
+static const int32 SettleFrameCount = 4;
+// Recommended lower bounds still meet the budget when the scene costs this much more than during calibration.
+static const float LoadMargin = 1.5f;
+// Headroom keeps this many standard deviations of GPU frame time free.
+static const float DeviationFactor = 3.0f;
+static const float LowestRecommendedFraction = 0.25f;
+
+static void ApplySetting(const TCHAR* Name, float Value)
+{
+	check(IsInGameThread());
+
+	if (IConsoleVariable* CVar = IConsoleManager::Get().FindConsoleVariable(Name))
+	{
+		CVar->Set(Value, ECVF_SetByCode);
+	}
+	GConfig->SetString(TEXT("SystemSettings"), Name, *FString::SanitizeFloat(Value), GEngineIni);
+}
+
+FVarjoDynamicResolutionCalibration::FVarjoDynamicResolutionCalibration()
+	: CurrentStep(0)
+	, SettleFrames(0)
+	, ContextMax(1.0f)
+	, FocusMax(1.0f)
+	, FramePeriodMs(0.0f)
+	, bActive(false)
+{
+}
+
+bool FVarjoDynamicResolutionCalibration::Activate()
+{
+	return !bActive.AtomicSet(true);
+}
+
+void FVarjoDynamicResolutionCalibration::Start(float InContextMax, float InFocusMax, float InFramePeriodMs, bool bTimestampQueries)
+{
+	check(IsInRenderingThread());
+
+	ContextMax = InContextMax;
+	FocusMax = FMath::Max(InFocusMax, InContextMax);
+	FramePeriodMs = InFramePeriodMs;
+	bActive = true;
+
+	// Context views swept with the focus views at their upper bound, then focus views with the context views at the floor.
+	const float Floor = FMath::Min(SweepFloor, ContextMax);
+	Steps.Reset();
+	for (int32 i = 0; i < SweepPoints; i++)
+	{
+		const float Alpha = float(i) / (SweepPoints - 1);
+		Steps.Add(FStep{ FMath::Lerp(ContextMax, Floor, Alpha), FocusMax, 0.0f, 0.0f, 0.0f });
+	}
+	for (int32 i = 1; i < SweepPoints; i++)
+	{
+		const float Alpha = float(i) / (SweepPoints - 1);
+		Steps.Add(FStep{ Floor, FMath::Lerp(FocusMax, Floor, Alpha), 0.0f, 0.0f, 0.0f });
+	}
+
+	CurrentStep = 0;
+	SettleFrames = SettleFrameCount;
+	TotalTimes.Reset();
+	DynamicResolutionTimes.Reset();
+	SET_DWORD_STAT(STAT_VarjoDynRes_CalibrationStep, 1);
+
+	UE_LOG(LogVarjoHMD, Log, TEXT("Dynamic resolution calibration started: %d steps of %d frames, compositor period %.2f ms."),
+		Steps.Num(), FMath::Max(CVarVarjoDynamicResCalibrationFrames.GetValueOnRenderThread(), 1), FramePeriodMs);
+	if (!bTimestampQueries)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Timestamp queries are not in use, dynamic resolution calibration fits the whole GPU frame time."));
+	}
+}
+
+void FVarjoDynamicResolutionCalibration::Cancel()
+{
+	check(IsInRenderingThread());
+
+	if (IsRunning())
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Dynamic resolution calibration cancelled at step %d of %d."), CurrentStep + 1, Steps.Num());
+	}
+	Steps.Reset();
+	TotalTimes.Reset();
+	DynamicResolutionTimes.Reset();
+	SET_DWORD_STAT(STAT_VarjoDynRes_CalibrationStep, 0);
+	bActive = false;
+}
+
+void FVarjoDynamicResolutionCalibration::GetViewFractions(float& OutContextFraction, float& OutFocusFraction) const
+{
+	check(IsRunning());
+	OutContextFraction = Steps[CurrentStep].ContextFraction;
+	OutFocusFraction = Steps[CurrentStep].FocusFraction;
+}
+
+void FVarjoDynamicResolutionCalibration::AddFrameTimings(float ContextFraction, float FocusFraction, float TotalGPUTimeMs, float DynamicResolutionGPUTimeMs)
+{
+	check(IsInRenderingThread());
+
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	// Frames rendered before the step started land late; they belong to the previous step.
+	const FStep& Step = Steps[CurrentStep];
+	if (!FMath::IsNearlyEqual(ContextFraction, Step.ContextFraction) || !FMath::IsNearlyEqual(FocusFraction, Step.FocusFraction))
+	{
+		return;
+	}
+
+	if (SettleFrames > 0)
+	{
+		SettleFrames--;
+		return;
+	}
+
+	TotalTimes.Add(TotalGPUTimeMs);
+	DynamicResolutionTimes.Add(DynamicResolutionGPUTimeMs);
+	if (TotalTimes.Num() >= FMath::Max(CVarVarjoDynamicResCalibrationFrames.GetValueOnRenderThread(), 1))
+	{
+		FinishStep();
+	}
+}
+
+void FVarjoDynamicResolutionCalibration::FinishStep()
+{
+	float Mean = 0.0f;
+	for (float Time : TotalTimes)
+	{
+		Mean += Time;
+	}
+	Mean /= TotalTimes.Num();
+
+	float Variance = 0.0f;
+	for (float Time : TotalTimes)
+	{
+		Variance += FMath::Square(Time - Mean);
+	}
+	Variance /= TotalTimes.Num();
+
+	// Medians, so that a hitch during the step does not skew the fit.
+	TotalTimes.Sort();
+	DynamicResolutionTimes.Sort();
+
+	FStep& Step = Steps[CurrentStep];
+	Step.TotalTimeMs = TotalTimes[TotalTimes.Num() / 2];
+	Step.DynamicResolutionTimeMs = DynamicResolutionTimes[DynamicResolutionTimes.Num() / 2];
+	Step.TotalTimeDeviationMs = FMath::Sqrt(Variance);
+
+	UE_LOG(LogVarjoHMD, Verbose, TEXT("Dynamic resolution calibration step %d: context %.3f, focus %.3f, GPU %.2f ms (dynamic %.2f ms, deviation %.2f ms)."),
+		CurrentStep + 1, Step.ContextFraction, Step.FocusFraction, Step.TotalTimeMs, Step.DynamicResolutionTimeMs, Step.TotalTimeDeviationMs);
+
+	TotalTimes.Reset();
+	DynamicResolutionTimes.Reset();
+	SettleFrames = SettleFrameCount;
+	CurrentStep++;
+	SET_DWORD_STAT(STAT_VarjoDynRes_CalibrationStep, CurrentStep + 1);
+
+	if (CurrentStep == Steps.Num())
+	{
+		Finish();
+	}
+}
+
+void FVarjoDynamicResolutionCalibration::Finish()
+{
+	// Least squares fit of DynamicResolutionTime = ContextCost * Context^2 + FocusCost * Focus^2, where the costs are
+	// the full-resolution GPU times of both views of the class. The rest of the frame is taken as fixed.
+	double Sxx = 0.0, Sxy = 0.0, Syy = 0.0, Sxd = 0.0, Syd = 0.0;
+	float FixedCostMs = 0.0f;
+	TArray<float> Deviations;
+	for (const FStep& Step : Steps)
+	{
+		const double X = FMath::Square(Step.ContextFraction);
+		const double Y = FMath::Square(Step.FocusFraction);
+		Sxx += X * X;
+		Sxy += X * Y;
+		Syy += Y * Y;
+		Sxd += X * Step.DynamicResolutionTimeMs;
+		Syd += Y * Step.DynamicResolutionTimeMs;
+		FixedCostMs += FMath::Max(Step.TotalTimeMs - Step.DynamicResolutionTimeMs, 0.0f);
+		Deviations.Add(Step.TotalTimeDeviationMs);
+	}
+	FixedCostMs /= Steps.Num();
+	Deviations.Sort();
+	const float DeviationMs = Deviations[Deviations.Num() / 2];
+
+	const float SweepContextMax = ContextMax;
+	const float SweepFocusMax = FocusMax;
+	const double Det = Sxx * Syy - Sxy * Sxy;
+	Steps.Reset();
+	SET_DWORD_STAT(STAT_VarjoDynRes_CalibrationStep, 0);
+
+	if (Det <= SMALL_NUMBER)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Dynamic resolution calibration failed: context and focus fractions were not varied independently (context max %.3f)."), SweepContextMax);
+		bActive = false;
+		return;
+	}
+
+	const float ContextCostMs = FMath::Max(float((Sxd * Syy - Syd * Sxy) / Det), 0.0f);
+	const float FocusCostMs = FMath::Max(float((Syd * Sxx - Sxd * Sxy) / Det), 0.0f);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_CalibrationFixedCost, FixedCostMs);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_CalibrationContextCost, ContextCostMs);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_CalibrationFocusCost, FocusCostMs);
+
+	const float Headroom = FMath::Clamp(1.0f - DeviationFactor * DeviationMs / FramePeriodMs, 0.5f, 0.95f);
+	const float BudgetMs = FramePeriodMs * Headroom;
+
+	// Lowest fractions that meet the budget under a heavier scene, context views giving way first as at runtime.
+	const float AvailableMs = FMath::Max(BudgetMs - FixedCostMs, 0.0f) / LoadMargin;
+	const float ContextMin = FMath::Clamp(FMath::Sqrt(FMath::Max(AvailableMs - FocusCostMs * FMath::Square(SweepFocusMax), 0.0f) / FMath::Max(ContextCostMs, SMALL_NUMBER)),
+		LowestRecommendedFraction, SweepContextMax);
+	const float FocusMin = FMath::Clamp(FMath::Sqrt(FMath::Max(AvailableMs - ContextCostMs * FMath::Square(ContextMin), 0.0f) / FMath::Max(FocusCostMs, SMALL_NUMBER)),
+		ContextMin, SweepFocusMax);
+
+	UE_LOG(LogVarjoHMD, Log, TEXT("Dynamic resolution calibration: fixed %.2f ms, context views %.2f ms, focus views %.2f ms at full resolution, deviation %.2f ms."),
+		FixedCostMs, ContextCostMs, FocusCostMs, DeviationMs);
+	UE_LOG(LogVarjoHMD, Log, TEXT("Recommended budget %.2f ms (headroom %.2f of %.2f ms), context [%.3f, %.3f], focus [%.3f, %.3f]."),
+		BudgetMs, Headroom, FramePeriodMs, ContextMin, SweepContextMax, FocusMin, SweepFocusMax);
+	if (FixedCostMs >= BudgetMs)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Work that does not scale with resolution takes %.2f ms, over the %.2f ms budget. Dynamic resolution cannot meet the compositor deadline."),
+			FixedCostMs, BudgetMs);
+	}
+
+	AsyncTask(ENamedThreads::GameThread, [ContextMin, SweepContextMax, FocusMin, SweepFocusMax, Headroom]()
+	{
+		ApplySetting(TEXT("vr.Varjo.DynamicResContextMin"), ContextMin);
+		ApplySetting(TEXT("vr.Varjo.DynamicResContextMax"), SweepContextMax);
+		ApplySetting(TEXT("vr.Varjo.DynamicResFocusMin"), FocusMin);
+		ApplySetting(TEXT("vr.Varjo.DynamicResFocusMax"), SweepFocusMax);
+		ApplySetting(TEXT("vr.Varjo.DynamicResHeadroom"), Headroom);
+		GConfig->Flush(false, GEngineIni);
+		UE_LOG(LogVarjoHMD, Log, TEXT("Dynamic resolution calibration written to [SystemSettings] in %s."), *GEngineIni);
+	});
+	bActive = false;
+}
@@ -0,0 +1,55 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/ThreadSafeBool.h"
+
+/**
+ * Dynamic resolution calibration sweep. Renders a fixed series of context and focus view fractions, measures the
+ * GPU time of each, fits the full-resolution cost of the context views, the focus views and the work that does not
+ * scale, and writes recommended fraction bounds and headroom to the [SystemSettings] section of the engine config.
+ * Samples and fractions are render thread only; the active flag may be read from any thread.
+ */
+class FVarjoDynamicResolutionCalibration
+{
+public:
+	FVarjoDynamicResolutionCalibration();
+
+	// Marks a sweep as requested. Returns false if one is already active. Game thread.
+	bool Activate();
+	bool IsActive() const { return bActive; }
+
+	// Builds the sweep from the current upper bounds of the view fractions.
+	void Start(float ContextMax, float FocusMax, float FramePeriodMs, bool bTimestampQueries);
+	void Cancel();
+	// True while the sweep decides the view fractions.
+	bool IsRunning() const { return Steps.Num() > 0; }
+	void GetViewFractions(float& OutContextFraction, float& OutFocusFraction) const;
+	// GPU timings of a frame rendered at the given view fractions. Advances the sweep; on the last step, applies the
+	// result on the game thread.
+	void AddFrameTimings(float ContextFraction, float FocusFraction, float TotalGPUTimeMs, float DynamicResolutionGPUTimeMs);
+
+private:
+	struct FStep
+	{
+		float ContextFraction;
+		float FocusFraction;
+		float TotalTimeMs;
+		float DynamicResolutionTimeMs;
+		float TotalTimeDeviationMs;
+	};
+
+	void FinishStep();
+	void Finish();
+
+	TArray<FStep> Steps;
+	int32 CurrentStep;
+	int32 SettleFrames;
+	TArray<float> TotalTimes;
+	TArray<float> DynamicResolutionTimes;
+	float ContextMax;
+	float FocusMax;
+	float FramePeriodMs;
+	FThreadSafeBool bActive;
+};
@@ -0,0 +1,234 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#include "VarjoDynamicResolutionController.h"
+#include "VarjoHMD.h"
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResHeadroom(
+	TEXT("vr.Varjo.DynamicResHeadroom"),
+	0.9f,
+	TEXT("Share of the compositor frame period the GPU frame is allowed to take, in range [0.5, 1]."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResDeadband(
+	TEXT("vr.Varjo.DynamicResDeadband"),
+	0.02f,
+	TEXT("Predicted resolution fraction changes smaller than this are ignored, to keep the fraction from oscillating."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResDownRate(
+	TEXT("vr.Varjo.DynamicResDownRate"),
+	0.15f,
+	TEXT("Largest resolution fraction decrease per measured frame."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResUpRate(
+	TEXT("vr.Varjo.DynamicResUpRate"),
+	0.01f,
+	TEXT("Largest resolution fraction increase per measured frame."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDynamicResSpikeFactor(
+	TEXT("vr.Varjo.DynamicResSpikeFactor"),
+	1.5f,
+	TEXT("A GPU frame taking this many times the recent median is treated as a spike and ignored, unless the next frame is slow too."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDualViewFallback(
+	TEXT("vr.Varjo.DualViewFallback"),
+	1,
+	TEXT("Stop rendering the focus views when the GPU misses its budget at the lowest resolution fraction.\n")
+	TEXT("Only the context views are rendered and submitted until there is headroom again. Needs the Varjo dynamic resolution controller.\n")
+	TEXT("0: always render all four views\n")
+	TEXT("1: automatic (default)"),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDualViewFallbackFrames(
+	TEXT("vr.Varjo.DualViewFallbackFrames"),
+	30,
+	TEXT("Consecutive measured frames over budget at the lowest resolution fraction before the focus views are dropped."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<int32> CVarVarjoDualViewRestoreFrames(
+	TEXT("vr.Varjo.DualViewRestoreFrames"),
+	90,
+	TEXT("Consecutive measured frames with headroom before the focus views are rendered again."),
+	ECVF_RenderThreadSafe);
+
+static TAutoConsoleVariable<float> CVarVarjoDualViewRestoreShare(
+	TEXT("vr.Varjo.DualViewRestoreShare"),
+	0.6f,
+	TEXT("Share of the budget the context views may take at the highest resolution fraction for the focus views to be rendered again."),
+	ECVF_RenderThreadSafe);
+
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Fraction"), STAT_VarjoDynRes_Fraction, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Predicted Fraction"), STAT_VarjoDynRes_PredictedFraction, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes GPU Time (ms)"), STAT_VarjoDynRes_GPUTime, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Budget (ms)"), STAT_VarjoDynRes_Budget, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Slack (ms)"), STAT_VarjoDynRes_Slack, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("DynRes Compositor Period (ms)"), STAT_VarjoDynRes_Period, STATGROUP_Varjo);
+DECLARE_DWORD_COUNTER_STAT(TEXT("DynRes Rejected Spikes"), STAT_VarjoDynRes_RejectedSpikes, STATGROUP_Varjo);
+
+// Used until the compositor period has been measured.
+static const float DefaultFramePeriodMs = 1000.0f / 90.0f;
+static const int32 SpikeHistorySize = 9;
+static const int32 ConvergedFrames = 90;
+
+FVarjoDynamicResolutionController::FVarjoDynamicResolutionController()
+	: FramePeriodMs(0.0f)
+{
+	Reset(1.0f);
+}
+
+void FVarjoDynamicResolutionController::Reset(float InitialFraction)
+{
+	Fraction = InitialFraction;
+	History.Reset();
+	HistoryIndex = 0;
+	bLastSampleWasSpike = false;
+	StableFrames = 0;
+	RejectedSpikes = 0;
+	bDualView = false;
+	ViewModeFrames = 0;
+}
+
+void FVarjoDynamicResolutionController::Seed(float InitialFraction, float GPUTimeMs)
+{
+	Reset(InitialFraction);
+
+	// A full history lets spike rejection work from the first frame.
+	History.Init(GPUTimeMs, SpikeHistorySize);
+}
+
+void FVarjoDynamicResolutionController::ClearDualView()
+{
+	bDualView = false;
+	ViewModeFrames = 0;
+}
+
+bool FVarjoDynamicResolutionController::IsConverged() const
+{
+	return StableFrames >= ConvergedFrames && !bDualView;
+}
+
+float FVarjoDynamicResolutionController::GetMedianGPUTimeMs() const
+{
+	if (History.Num() == 0)
+	{
+		return 0.0f;
+	}
+
+	TArray<float> Sorted = History;
+	Sorted.Sort();
+	return Sorted[Sorted.Num() / 2];
+}
+
+void FVarjoDynamicResolutionController::SetFramePeriodMs(float PeriodMs)
+{
+	FramePeriodMs = PeriodMs;
+}
+
+float FVarjoDynamicResolutionController::GetFramePeriodMs() const
+{
+	return FramePeriodMs > 0.0f ? FramePeriodMs : DefaultFramePeriodMs;
+}
+
+bool FVarjoDynamicResolutionController::IsSpike(float TotalGPUTimeMs)
+{
+	bool bSpike = false;
+	if (History.Num() == SpikeHistorySize)
+	{
+		bSpike = TotalGPUTimeMs > GetMedianGPUTimeMs() * FMath::Max(CVarVarjoDynamicResSpikeFactor.GetValueOnRenderThread(), 1.0f);
+	}
+
+	if (History.Num() < SpikeHistorySize)
+	{
+		History.Add(TotalGPUTimeMs);
+	}
+	else
+	{
+		History[HistoryIndex] = TotalGPUTimeMs;
+		HistoryIndex = (HistoryIndex + 1) % SpikeHistorySize;
+	}
+
+	// A second slow frame in a row is a real change in load.
+	const bool bReject = bSpike && !bLastSampleWasSpike;
+	bLastSampleWasSpike = bSpike;
+	return bReject;
+}
+
+void FVarjoDynamicResolutionController::UpdateViewMode(float TotalGPUTimeMs, float BudgetMs, float MinFraction, float MaxFraction)
+{
+	if (CVarVarjoDualViewFallback.GetValueOnRenderThread() == 0)
+	{
+		bDualView = false;
+		ViewModeFrames = 0;
+		return;
+	}
+
+	// Drop the focus views only when lowering the resolution has nothing left to give, and bring them back only
+	// once the context views alone leave a clear margin at full fraction. The gap between the two keeps the mode
+	// from flipping back and forth.
+	const bool bWantsOtherMode = bDualView
+		? Fraction >= MaxFraction - KINDA_SMALL_NUMBER && TotalGPUTimeMs < BudgetMs * FMath::Clamp(CVarVarjoDualViewRestoreShare.GetValueOnRenderThread(), 0.1f, 0.9f)
+		: Fraction <= MinFraction + KINDA_SMALL_NUMBER && TotalGPUTimeMs > BudgetMs;
+	ViewModeFrames = bWantsOtherMode ? ViewModeFrames + 1 : 0;
+
+	const int32 RequiredFrames = bDualView ? CVarVarjoDualViewRestoreFrames.GetValueOnRenderThread() : CVarVarjoDualViewFallbackFrames.GetValueOnRenderThread();
+	if (ViewModeFrames >= FMath::Max(RequiredFrames, 1))
+	{
+		bDualView = !bDualView;
+		ViewModeFrames = 0;
+		UE_LOG(LogVarjoHMD, Log, TEXT("DynRes: GPU %.2f ms against a %.2f ms budget, %s the focus views."),
+			TotalGPUTimeMs, BudgetMs, bDualView ? TEXT("dropping") : TEXT("restoring"));
+	}
+}
+
+void FVarjoDynamicResolutionController::AddFrameTimings(float SampleFraction, float TotalGPUTimeMs, float DynamicResolutionGPUTimeMs, float MinFraction, float MaxFraction)
+{
+	check(IsInRenderingThread());
+
+	const float PeriodMs = GetFramePeriodMs();
+	const float BudgetMs = PeriodMs * FMath::Clamp(CVarVarjoDynamicResHeadroom.GetValueOnRenderThread(), 0.5f, 1.0f);
+
+	SET_FLOAT_STAT(STAT_VarjoDynRes_GPUTime, TotalGPUTimeMs);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_Budget, BudgetMs);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_Slack, BudgetMs - TotalGPUTimeMs);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_Period, PeriodMs);
+
+	if (IsSpike(TotalGPUTimeMs))
+	{
+		RejectedSpikes++;
+		SET_DWORD_STAT(STAT_VarjoDynRes_RejectedSpikes, RejectedSpikes);
+		return;
+	}
+
+	// The dynamic resolution section costs the same per pixel, so it scales with the square of the fraction;
+	// the rest of the frame does not scale.
+	const float FixedTimeMs = FMath::Max(TotalGPUTimeMs - DynamicResolutionGPUTimeMs, 0.0f);
+	const float FullResolutionTimeMs = DynamicResolutionGPUTimeMs / FMath::Square(FMath::Max(SampleFraction, 0.01f));
+	float Predicted = MaxFraction;
+	if (FullResolutionTimeMs > 0.0f)
+	{
+		Predicted = FMath::Sqrt(FMath::Max(BudgetMs - FixedTimeMs, 0.0f) / FullResolutionTimeMs);
+	}
+	Predicted = FMath::Clamp(Predicted, MinFraction, MaxFraction);
+
+	const float Delta = Predicted - Fraction;
+	StableFrames++;
+	if (FMath::Abs(Delta) > CVarVarjoDynamicResDeadband.GetValueOnRenderThread())
+	{
+		StableFrames = 0;
+		// Drop quickly to make the deadline, recover slowly to avoid overshooting it again.
+		Fraction += Delta < 0.0f
+			? FMath::Max(Delta, -CVarVarjoDynamicResDownRate.GetValueOnRenderThread())
+			: FMath::Min(Delta, CVarVarjoDynamicResUpRate.GetValueOnRenderThread());
+	}
+	Fraction = FMath::Clamp(Fraction, MinFraction, MaxFraction);
+
+	UpdateViewMode(TotalGPUTimeMs, BudgetMs, MinFraction, MaxFraction);
+
+	SET_FLOAT_STAT(STAT_VarjoDynRes_PredictedFraction, Predicted);
+	SET_FLOAT_STAT(STAT_VarjoDynRes_Fraction, Fraction);
+	UE_LOG(LogVarjoHMD, VeryVerbose, TEXT("DynRes: GPU %.2f ms (dynamic %.2f ms) at %.3f, budget %.2f ms, predicted %.3f, fraction %.3f."),
+		TotalGPUTimeMs, DynamicResolutionGPUTimeMs, SampleFraction, BudgetMs, Predicted, Fraction);
+}
@@ -0,0 +1,55 @@
+// Copyright 6/4/2019 Varjo Technologies Oy. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Resolution fraction controller aimed at the Varjo compositor deadline. Predicts the fraction that fits the
+ * GPU frame into a share of the compositor frame period, assuming the dynamic resolution section scales with
+ * pixel count, and moves towards it with a dead band, fast-down/slow-up rate limits and single-frame spike
+ * rejection. When the fraction is at its minimum and frames still miss the budget, asks for the focus views to be
+ * dropped until there is headroom again. Render thread only.
+ */
+class FVarjoDynamicResolutionController
+{
+public:
+	FVarjoDynamicResolutionController();
+
+	void Reset(float InitialFraction);
+	// Starts from a fraction and GPU frame time known to be steady for the content, e.g. from a previous session.
+	void Seed(float InitialFraction, float GPUTimeMs);
+	// Compositor frame period, 0 if not known yet.
+	void SetFramePeriodMs(float PeriodMs);
+	// Measured compositor frame period, or the default until it is known.
+	float GetFramePeriodMs() const;
+	bool HasFramePeriod() const { return FramePeriodMs > 0.0f; }
+	// GPU timings of a frame rendered at SampleFraction. Updates the fraction.
+	void AddFrameTimings(float SampleFraction, float TotalGPUTimeMs, float DynamicResolutionGPUTimeMs, float MinFraction, float MaxFraction);
+	float GetFraction() const { return Fraction; }
+	// True while only the context views should be rendered.
+	bool IsDualView() const { return bDualView; }
+	// Goes back to rendering all four views, e.g. while something else decides the fractions.
+	void ClearDualView();
+	// True once the fraction has held for a while, so that it is worth remembering.
+	bool IsConverged() const;
+	// Median of the recent GPU frame times, 0 before any were measured.
+	float GetMedianGPUTimeMs() const;
+
+private:
+	bool IsSpike(float TotalGPUTimeMs);
+	void UpdateViewMode(float TotalGPUTimeMs, float BudgetMs, float MinFraction, float MaxFraction);
+
+	float Fraction;
+	float FramePeriodMs;
+	// Recent GPU frame times, for spike detection.
+	TArray<float> History;
+	int32 HistoryIndex;
+	bool bLastSampleWasSpike;
+	// Measured frames since the fraction last moved.
+	int32 StableFrames;
+	uint32 RejectedSpikes;
+	bool bDualView;
+	// Consecutive measured frames asking for the other view mode.
+	int32 ViewModeFrames;
+};
@@ -3,6 +3,7 @@
 #include "VarjoHMD.h"
 #include "VarjoDynamicResolution.h"
 #include "Engine/GameEngine.h"
+#include "Engine/World.h"
 #include "Runtime/Engine/Public/UnrealEngine.h"
 #include "HardwareInfo.h"
 #include "ScreenRendering.h"
@@ -14,6 +15,35 @@
 
 DEFINE_LOG_CATEGORY(LogVarjoHMD);
 
+static TAutoConsoleVariable<int32> CVarVarjoSubmitDepth(
+	TEXT("vr.Varjo.SubmitDepth"),
+	0,
+	TEXT("Submit scene depth to the Varjo compositor for depth-aware reprojection.\n")
+	TEXT("0: color only (default)\n")
+	TEXT("1: color and depth"),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarVarjoWarmStandby(
+	TEXT("vr.Varjo.WarmStandby"),
+	0,
+	TEXT("Keep the Varjo session, swap chains and render targets alive while stereo is disabled.\n")
+	TEXT("0: disabling stereo shuts the session down (default)\n")
+	TEXT("1: disabling stereo only suspends frame submission, so enabling it again is near-instant"),
+	ECVF_Default);
+
+static FAutoConsoleCommand CVarVarjoCalibrateDynamicRes(
+	TEXT("vr.Varjo.CalibrateDynamicRes"),
+	TEXT("Sweeps the context and focus view fractions, measures GPU time at each step and writes recommended\n")
+	TEXT("vr.Varjo.DynamicRes* bounds and headroom to [SystemSettings] in the engine config.\n")
+	TEXT("Takes a few seconds; keep the camera on representative content. Needs dynamic resolution enabled."),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		if (GEngine->XRSystem.IsValid() && GEngine->XRSystem->GetSystemName() == FVarjoHMD::VarjoSystemName)
+		{
+			static_cast<FVarjoHMD*>(GEngine->XRSystem.Get())->StartDynamicResolutionCalibration();
+		}
+	}));
+
 const FName FVarjoHMD::VarjoSystemName(TEXT("VarjoHMD"));
 
 FVarjoHMD::FVarjoHMD(const FAutoRegister& AutoRegister, IVarjoHMDPlugin* plugin)
@@ -368,8 +398,8 @@ bool FVarjoHMD::GetHMDMonitorInfo(MonitorInfo& MonitorDesc)
 	MonitorDesc.MonitorId = 0;
 	MonitorDesc.DesktopX = 0;
 	MonitorDesc.DesktopY = 0;
-	MonitorDesc.ResolutionX = 4096;
-	MonitorDesc.ResolutionY = 3200;
+	MonitorDesc.ResolutionX = m_atlasLayout.GetAtlasSize().X;
+	MonitorDesc.ResolutionY = m_atlasLayout.GetAtlasSize().Y;
 	return true;
 }
 
@@ -399,33 +429,19 @@ bool FVarjoHMD::IsChromaAbCorrectionEnabled() const
 
 void FVarjoHMD::AdjustViewRect(EStereoscopicPass StereoPass, int32& X, int32& Y, uint32& SizeX, uint32& SizeY) const
 {
-	SizeX = 2048;
-
-	// Left and right are swapped here.
-	if (StereoPass == eSSP_LEFT_EYE)
-	{
-		X = 0;
-		Y = 0;
-		SizeY = 2048;
-	}
-	else if (StereoPass == eSSP_RIGHT_EYE)
-	{
-		X = 2048;
-		Y = 0;
-		SizeY = 2048;
-	}
-	else if (StereoPass == eSSP_LEFT_FOCUS)
-	{
-		X = 0;
-		Y = 2048;
-		SizeY = 1152;
-	}
-	else if (StereoPass == eSSP_RIGHT_FOCUS)
+	if (StereoPass != eSSP_LEFT_EYE && StereoPass != eSSP_RIGHT_EYE && StereoPass != eSSP_LEFT_FOCUS && StereoPass != eSSP_RIGHT_FOCUS)
 	{
-		X = 2048;
-		Y = 2048;
-		SizeY = 1152;
+		return;
 	}
+
+	const uint32 viewIndex = GetViewIndexForPass(StereoPass);
+	const FIntRect viewRect = viewIndex > 1
+		? FVarjoAtlasLayout::NarrowViewRect(m_atlasLayout.GetViewRect(viewIndex), m_focusAreaScale)
+		: m_atlasLayout.GetViewRect(viewIndex);
+	X = viewRect.Min.X;
+	Y = viewRect.Min.Y;
+	SizeX = viewRect.Width();
+	SizeY = viewRect.Height();
 }
 
 FMatrix FVarjoHMD::GetStereoProjectionMatrix(const enum EStereoscopicPass StereoPassType) const
@@ -449,8 +465,17 @@ FMatrix FVarjoHMD::GetStereoProjectionMatrix(const enum EStereoscopicPass Stereo
 	{
 		i = 3;
 	}
-	return m_currentProjections[i];
 
+	FMatrix projection = m_currentProjections[i];
+	if (i > 1 && m_focusAreaScale < 1.0f)
+	{
+		// Narrow the focus frustum around its center: both the extent and the off-center shift scale with it.
+		projection.M[0][0] /= m_focusAreaScale;
+		projection.M[1][1] /= m_focusAreaScale;
+		projection.M[2][0] /= m_focusAreaScale;
+		projection.M[2][1] /= m_focusAreaScale;
+	}
+	return projection;
 }
 
 EStereoscopicPass FVarjoHMD::GetViewPassForIndex(bool bStereoRequested, uint32 ViewIndex) const
@@ -565,14 +590,16 @@ void FVarjoHMD::RenderTexture_RenderThread(class FRHICommandListImmediate& RHICm
 
 		pixelShader->SetParameters(RHICmdList, TStaticSamplerState<SF_Bilinear>::GetRHI(), SrcTexture);
 
-		float resolutionFraction = m_bridge->getResolutionFraction();
+		// Mirror the left context view.
+		const FIntRect contextRect = m_atlasLayout.GetScaledViewRect(0, m_bridge->getResolutionFraction(0));
+		const FIntPoint atlasSize = m_atlasLayout.GetAtlasSize();
 
 		m_rendererModule->DrawRectangle(
 			RHICmdList,
 			0, 0, // X, Y
-			viewportWidth * 2.0f / resolutionFraction, viewportHeight * (25.0f / 16.0f) / resolutionFraction, // SizeX, SizeY
-			0.0f, 0.0f, // U, V
-			1.0f, 1.0f, // SizeU, SizeV
+			viewportWidth, viewportHeight, // SizeX, SizeY
+			float(contextRect.Min.X) / atlasSize.X, float(contextRect.Min.Y) / atlasSize.Y, // U, V
+			float(contextRect.Width()) / atlasSize.X, float(contextRect.Height()) / atlasSize.Y, // SizeU, SizeV
 			FIntPoint(viewportWidth, viewportHeight), // TargetSize
 			FIntPoint(1, 1), // TextureSize
 			*vertexShader,
@@ -612,7 +639,7 @@ DECLARE_CYCLE_STAT(TEXT("Varjo UpdateHMDPose"), STAT_FVarjoHMD_UpdateHMDPose, ST
 bool FVarjoHMD::UpdateHMDPose()
 {
 	SCOPE_CYCLE_COUNTER(STAT_FVarjoHMD_UpdateHMDPose);
-	if (m_bridge->isInitialized() == false)
+	if (m_bridge == nullptr || m_bridge->isInitialized() == false)
 	{
 		return false;
 	}
@@ -661,7 +688,7 @@ bool FVarjoHMD::GetCurrentPose(int32 DeviceId, FQuat& CurrentOrientation, FVecto
 	if (!DeviceId)
 	{
 		FVarjoXRCamera* pVarjoXRCamera = static_cast<FVarjoXRCamera*>(FVarjoHMD::GetXRCamera(0).Get());
-		if (pVarjoXRCamera->HeadtrackingEnabled && m_bridge->isInitialized())
+		if (pVarjoXRCamera->HeadtrackingEnabled && m_bridge != nullptr && m_bridge->isInitialized())
 		{
 			if (IsInGameThread())
 			{
@@ -713,6 +740,8 @@ bool FVarjoHMD::GetCurrentPose(int32 DeviceId, FQuat& CurrentOrientation, FVecto
 }
 
 DECLARE_CYCLE_STAT(TEXT("Varjo OnStartGameFrame"), STAT_FVarjoHMD_OnStartGameFrame, STATGROUP_Varjo);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Varjo View Mode Switches"), STAT_FVarjoHMD_ViewModeSwitches, STATGROUP_Varjo);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Varjo Focus Area Scale"), STAT_FVarjoHMD_FocusAreaScale, STATGROUP_Varjo);
 bool FVarjoHMD::OnStartGameFrame(FWorldContext& WorldContext)
 {
 	SCOPE_CYCLE_COUNTER(STAT_FVarjoHMD_OnStartGameFrame);
@@ -720,10 +749,92 @@ bool FVarjoHMD::OnStartGameFrame(FWorldContext& WorldContext)
 	{
 		m_bridge->handleVarjoEvents(WorldContext.GameViewport);
 	}
+	if (m_bridge != nullptr && m_bridge->isInitialized())
+	{
+		// The bridge reads the flag while rendering, so it changes in order with the frames already queued.
+		TRefCountPtr<VarjoCustomPresent> bridge = m_bridge;
+		const bool submitDepth = CVarVarjoSubmitDepth.GetValueOnGameThread() != 0;
+		ENQUEUE_RENDER_COMMAND(VarjoSetDepthSubmission)(
+			[bridge, submitDepth](FRHICommandListImmediate&)
+			{
+				bridge->SetDepthSubmissionEnabled(submitDepth);
+			});
+	}
 	UpdatePoses();
+
+	if (m_stereoEnabled && m_dynamicResolutionState.IsValid() && WorldContext.World() != nullptr)
+	{
+		const FString mapName = UWorld::RemovePIEPrefix(WorldContext.World()->GetOutermost()->GetName());
+		if (mapName != m_dynamicResolutionMap)
+		{
+			m_dynamicResolutionMap = mapName;
+			m_dynamicResolutionState->SetWarmStartMap(mapName);
+		}
+	}
+
+	// Latched once per game frame so that every view family of the frame gets the same view count.
+	const bool dualView = m_stereoEnabled && m_dynamicResolutionState.IsValid() && m_dynamicResolutionState->IsDualView();
+	if (dualView != m_dualView)
+	{
+		m_dualView = dualView;
+		m_viewModeSwitches++;
+		UE_LOG(LogVarjoHMD, Log, TEXT("Rendering %s."), m_dualView ? TEXT("context views only") : TEXT("context and focus views"));
+	}
+	SET_DWORD_STAT(STAT_FVarjoHMD_ViewModeSwitches, m_viewModeSwitches);
+
+	// Focus view rects and projections of this frame's view families use it; the frame they begin carries the same value.
+	const float focusAreaScale = m_stereoEnabled && m_dynamicResolutionState.IsValid() ? m_dynamicResolutionState->GetFocusAreaScale() : 1.0f;
+	if (focusAreaScale != m_focusAreaScale)
+	{
+		m_focusAreaScale = focusAreaScale;
+		ENQUEUE_RENDER_COMMAND(VarjoSetFocusAreaScale)(
+			[this, focusAreaScale](FRHICommandListImmediate&)
+			{
+				m_renderFocusAreaScale = focusAreaScale;
+			});
+	}
+	SET_FLOAT_STAT(STAT_FVarjoHMD_FocusAreaScale, m_focusAreaScale);
+
+	if (GUsingNullRHI && m_stereoEnabled)
+	{
+		RunHeadlessFrame();
+	}
 	return true;
 }
 
+void FVarjoHMD::RunHeadlessFrame()
+{
+	if (m_bridge == nullptr || !m_bridge->isInitialized())
+	{
+		return;
+	}
+
+	// Nothing is rendered, so no view family begins the frame or presents it. Run the same steps in order
+	// with the frames the render thread already has queued.
+	TRefCountPtr<VarjoCustomPresent> bridge = m_bridge;
+	const int32 viewCount = GetDesiredNumberOfViews(true);
+	ENQUEUE_RENDER_COMMAND(VarjoHeadlessFrame)(
+		[this, bridge, viewCount](FRHICommandListImmediate& RHICmdList)
+		{
+			if (bridge->isSuspended())
+			{
+				return;
+			}
+
+			float contextFraction = 1.0f;
+			float focusFraction = 1.0f;
+			UpdateDynamicResolution_RenderThread(bridge, contextFraction, focusFraction);
+			bridge->BeginRendering(nullptr, viewCount, contextFraction, focusFraction, m_renderFocusAreaScale);
+
+			// The frame begins on the RHI thread, present it there too.
+			RHICmdList.EnqueueLambda([bridge](FRHICommandListImmediate&)
+			{
+				int syncInterval = 0;
+				bridge->Present(syncInterval);
+			});
+		});
+}
+
 void FVarjoHMD::PoseToOrientationAndPosition(const vr::HmdMatrix34_t& InPose, bool InFlip, FQuat& OutOrientation, FVector& OutPosition) const
 {
 	FMatrix Pose = ToFMatrix(InPose);
@@ -775,8 +886,48 @@ bool FVarjoHMD::IsStereoEnabled() const
  	return m_stereoEnabled;
 }
 
+void FVarjoHMD::SetBridgeSuspended(bool suspended)
+{
+	if (m_bridge == nullptr)
+	{
+		return;
+	}
+
+	TRefCountPtr<VarjoCustomPresent> bridge = m_bridge;
+	ENQUEUE_RENDER_COMMAND(VarjoSetBridgeSuspended)(
+		[bridge, suspended](FRHICommandListImmediate&)
+		{
+			bridge->setSuspended(suspended);
+		});
+}
+
+static void SetConsolveVariable(TCHAR * consoleVarName, int32 value)
+{
+	IConsoleVariable* consoleVar = IConsoleManager::Get().FindConsoleVariable(consoleVarName);
+	if (consoleVar)
+	{
+		consoleVar->Set(value);
+	}
+}
+
 bool FVarjoHMD::OnStereoTeardown()
 {
+	if (m_dynamicResolutionState.IsValid())
+	{
+		m_dynamicResolutionState->SaveWarmStart();
+	}
+
+	if (CVarVarjoWarmStandby.GetValueOnGameThread() != 0 && m_bridge != nullptr && m_bridge->isInitialized())
+	{
+		// Frames already in flight still submit; the next ones are not started.
+		SetBridgeSuspended(true);
+		m_standby = true;
+		GEngine->ChangeDynamicResolutionStateAtNextFrame(FDynamicResolutionHeuristicProxy::CreateDefaultState());
+		return true;
+	}
+
+	m_standby = false;
+	m_stereoWindowApplied = false;
 	Shutdown();
 	GEngine->ChangeDynamicResolutionStateAtNextFrame(FDynamicResolutionHeuristicProxy::CreateDefaultState());
 	FlushRenderingCommands();
@@ -785,13 +936,37 @@ bool FVarjoHMD::OnStereoTeardown()
 
 bool FVarjoHMD::OnStereoStartup()
 {
-	if (!Startup())
+	const bool resumeFromStandby = m_standby && m_dynamicResolutionState.IsValid();
+	if (m_standby)
+	{
+		m_standby = false;
+		SetBridgeSuspended(false);
+	}
+	else if (!Startup())
 	{
 		return false;
 	}
-	
-	int32 resX = 4096;
-	int32 resY = 3200;
+
+	// By default unreal buffers 1 frame, which in some cases may break compositor (cause stuttering).
+	// A triple buffered swap chain has room for the extra frame in flight. Set here, after Startup has
+	// initialized the layout for this session.
+	SetConsolveVariable(TEXT("r.OneFrameThreadLag"), m_atlasLayout.IsThroughputBuffering());
+
+	if (!resumeFromStandby)
+	{
+		m_dynamicResolutionState = MakeShareable(new FVarjoDynamicResolutionState(m_atlasLayout));
+		m_dynamicResolutionMap.Empty();
+	}
+	GEngine->ChangeDynamicResolutionStateAtNextFrame(m_dynamicResolutionState);
+
+	// The window keeps the HMD mode through a warm standby.
+	if (m_stereoWindowApplied)
+	{
+		return true;
+	}
+
+	int32 resX = m_atlasLayout.GetAtlasSize().X;
+	int32 resY = m_atlasLayout.GetAtlasSize().Y;
 	MonitorInfo MonitorDesc;
 	if (GetHMDMonitorInfo(MonitorDesc))
 	{
@@ -799,21 +974,10 @@ bool FVarjoHMD::OnStereoStartup()
 		resY = MonitorDesc.ResolutionY;
 	}
 	FSystemResolution::RequestResolutionChange(resX, resY, EWindowMode::WindowedFullscreen);
-
-	m_dynamicResolutionState = MakeShareable(new FVarjoDynamicResolutionState());
-	GEngine->ChangeDynamicResolutionStateAtNextFrame(m_dynamicResolutionState);
+	m_stereoWindowApplied = true;
 	return true;
 }
 
-static void SetConsolveVariable(TCHAR * consoleVarName, int32 value)
-{
-	IConsoleVariable* consoleVar = IConsoleManager::Get().FindConsoleVariable(consoleVarName);
-	if (consoleVar)
-	{
-		consoleVar->Set(value);
-	}
-}
-
 bool FVarjoHMD::EnableStereo(bool bStereo)
 {
 	if (m_stereoEnabled == bStereo)
@@ -826,8 +990,11 @@ bool FVarjoHMD::EnableStereo(bool bStereo)
 	// Enable FPS back to normal after Varjo System UI(low fps)
 	GEngine->bForceDisableFrameRateSmoothing = bStereo;
 
-	// By default unreal buffers 1 frame, which in some cases may break compositor (cause stuttering).
-	SetConsolveVariable(TEXT("r.OneFrameThreadLag"), bStereo == false);
+	// Stereo sets the frame lag in OnStereoStartup, once the atlas layout is known.
+	if (!bStereo)
+	{
+		SetConsolveVariable(TEXT("r.OneFrameThreadLag"), 1);
+	}
 #if RHI_RAYTRACING
 	SetConsolveVariable(TEXT("r.RayTracing.Shadows"), bStereo == false);
 	SetConsolveVariable(TEXT("r.RayTracing.Reflections"), bStereo == false);
@@ -884,6 +1051,7 @@ bool FVarjoHMD::Startup()
 	}
 	
 	FString RHIString;
+	if (!GUsingNullRHI)
 	{
 		FString HardwareDetails = FHardwareInfo::GetHardwareDetailsString();
 		FString RHILookup = NAME_RHI.ToString() + TEXT("=");
@@ -899,8 +1067,13 @@ bool FVarjoHMD::Startup()
 	{
 		UE_LOG(LogVarjoHMD, Warning, TEXT("Varjo software not installed or running!"));
 	}
+	m_atlasLayout.Init(m_session);
 
-	if (RHIString == TEXT("D3D11"))
+	if (GUsingNullRHI)
+	{
+		m_bridge = new VarjoCustomPresentNull(this);
+	}
+	else if (RHIString == TEXT("D3D11"))
 	{
 		m_bridge = new VarjoCustomPresentD3D11(this);
 	}
@@ -908,6 +1081,19 @@ bool FVarjoHMD::Startup()
 	{
 		m_bridge = new VarjoCustomPresentD3D12(this);
 	}
+#ifdef VARJO_USE_VULKAN
+	else if (RHIString == TEXT("Vulkan"))
+	{
+		m_bridge = new VarjoCustomPresentVulkan(this);
+	}
+#endif
+
+	if (m_bridge == nullptr)
+	{
+		UE_LOG(LogVarjoHMD, Warning, TEXT("%s is not currently supported by VarjoHMD plugin!"), *RHIString);
+		Shutdown();
+		return false;
+	}
 	m_bridge->Init();
 	return true;
 }
@@ -936,13 +1122,18 @@ void FVarjoHMD::OnBeginRendering_RenderThread(FRHICommandListImmediate& /* unuse
 {
 	SCOPE_CYCLE_COUNTER(STAT_FVarjoHMD_OnBeginRendering_RenderThread);
 	check(IsInRenderingThread());
-	if (m_bridge == nullptr)
+	// Headless frames are driven from the game thread.
+	if (m_bridge == nullptr || m_bridge->isSuspended() || GUsingNullRHI)
 	{
 		return;
 	}
 
-	m_bridge->BeginRendering();
-	
+	// The frame is captured for submission when it begins, so it needs this frame's view count and fractions.
+	float contextFraction = 1.0f;
+	float focusFraction = 1.0f;
+	UpdateDynamicResolution_RenderThread(m_bridge, contextFraction, focusFraction);
+	m_bridge->BeginRendering(ViewFamily.RenderTarget->GetRenderTargetTexture(), ViewFamily.Views.Num(), contextFraction, focusFraction, m_renderFocusAreaScale);
+
 	FMatrix invViewMatrix = ViewFamily.Views[0]->ViewMatrices.GetInvViewMatrix();
 	FMatrix right = ViewFamily.Views[1]->ViewMatrices.GetInvViewMatrix();
 
@@ -955,10 +1146,15 @@ void FVarjoHMD::OnBeginRendering_RenderThread(FRHICommandListImmediate& /* unuse
 
 	InvViewQuat = invViewMatrix.ToQuat();
 	InvViewOrigin = invViewMatrix.GetOrigin();
+}
 
+void FVarjoHMD::UpdateDynamicResolution_RenderThread(VarjoCustomPresent* bridge, float& OutContextFraction, float& OutFocusFraction)
+{
+	check(IsInRenderingThread());
 	if (m_dynamicResolutionState.IsValid())
 	{
-		m_bridge->setResolutionFraction(m_dynamicResolutionState->GetResolutionFraction());
+		m_dynamicResolutionState->SetFramePeriodMs(bridge->getFramePeriodMs());
+		m_dynamicResolutionState->GetViewFractions(OutContextFraction, OutFocusFraction);
 	}
 }
 
@@ -1002,8 +1198,8 @@ FXRRenderBridge* FVarjoHMD::GetActiveRenderBridge_GameThread(bool /* bUseSeparat
 
 void FVarjoHMD::CalculateRenderTargetSize(const class FViewport& Viewport, uint32& InOutSizeX, uint32& InOutSizeY)
 {
-	InOutSizeX = 4096;
-	InOutSizeY = 3200;
+	InOutSizeX = m_atlasLayout.GetAtlasSize().X;
+	InOutSizeY = m_atlasLayout.GetAtlasSize().Y;
 }
 
 bool FVarjoHMD::NeedReAllocateViewportRenderTarget(const FViewport& Viewport)
@@ -1024,27 +1220,45 @@ bool FVarjoHMD::NeedReAllocateViewportRenderTarget(const FViewport& Viewport)
 
 bool FVarjoHMD::NeedReAllocateDepthTexture(const TRefCountPtr<IPooledRenderTarget>& DepthTarget)
 {
-	FIntVector CurrentSize = DepthTarget->GetRenderTargetItem().TargetableTexture->GetSizeXYZ();
-	return CurrentSize.X != 4096 || CurrentSize.Y != 3200;
+	const FTextureRHIRef& TargetableTexture = DepthTarget->GetRenderTargetItem().TargetableTexture;
+	FIntVector CurrentSize = TargetableTexture->GetSizeXYZ();
+	if (CurrentSize.X != m_atlasLayout.GetAtlasSize().X || CurrentSize.Y != m_atlasLayout.GetAtlasSize().Y)
+	{
+		return true;
+	}
+
+	// Depth submission was turned on, or its grace period ran out: switch between swap chain and plain depth.
+	return m_bridge && m_bridge->isInitialized() && m_bridge->NeedReAllocateDepthTexture(TargetableTexture);
+}
+
+uint32 FVarjoHMD::GetNumberOfBufferedFrames() const
+{
+	if (m_bridge && m_bridge->isInitialized())
+	{
+		return m_bridge->GetNumberOfBufferedFrames();
+	}
+	return 1;
 }
 
 bool FVarjoHMD::AllocateRenderTargetTexture(uint32 Index, uint32 SizeX, uint32 SizeY, uint8 Format, uint32 NumMips, uint32 InTexFlags, uint32 InTargetableTextureFlags, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture, uint32 NumSamples)
 {
 	if (m_bridge && m_bridge->isInitialized())
 	{
-		return m_bridge->CreateRenderTargetTexture(OutTargetableTexture, OutShaderResourceTexture);
+		return m_bridge->CreateRenderTargetTexture(Index, NumSamples, OutTargetableTexture, OutShaderResourceTexture);
 	}
 	else
 	{
 		FRHIResourceCreateInfo CreateInfo;
-		RHICreateTargetableShaderResource2D(4096, 3200, PF_B8G8R8A8, 1, TexCreate_None, TexCreate_RenderTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
+		RHICreateTargetableShaderResource2D(m_atlasLayout.GetAtlasSize().X, m_atlasLayout.GetAtlasSize().Y, m_atlasLayout.GetColorPixelFormat(), 1, TexCreate_None, TexCreate_RenderTargetable, false, CreateInfo, OutTargetableTexture, OutShaderResourceTexture);
 		return true;
 	}
 }
 
 bool FVarjoHMD::AllocateDepthTexture(uint32 Index, uint32 SizeX, uint32 SizeY, uint8 Format, uint32 NumMips, uint32 InTexFlags, uint32 TargetableTextureFlags, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture, uint32 NumSamples)
 {
-	if (SizeX == 4096 && SizeY == 3200 && m_bridge->isInitialized())
+	// Multisampled scene depth cannot be submitted, let the engine allocate it.
+	const FIntPoint atlasSize = m_atlasLayout.GetAtlasSize();
+	if (SizeX == (uint32)atlasSize.X && SizeY == (uint32)atlasSize.Y && NumSamples <= 1 && m_bridge != nullptr && m_bridge->isInitialized())
 	{
 		return m_bridge->CreateDepthTargetTexture(OutTargetableTexture, OutShaderResourceTexture);
 	}
@@ -1067,10 +1281,23 @@ void FVarjoHMD::SetHeadtrackingEnabled(bool enabled)
 
 void FVarjoHMD::SetDepthSubmissionEnabled(bool enabled)
 {
-	if (m_bridge && m_bridge->isInitialized())
+	// The CVar is the single source of truth; it is pushed to the bridge at the start of every game frame.
+	CVarVarjoSubmitDepth->Set(enabled ? 1 : 0, ECVF_SetByCode);
+}
+
+bool FVarjoHMD::StartDynamicResolutionCalibration()
+{
+	if (!m_stereoEnabled || !m_dynamicResolutionState.IsValid())
 	{
-		m_bridge->SetDepthSubmissionEnabled(enabled);
+		UE_LOG(LogVarjoHMD, Warning, TEXT("Dynamic resolution calibration needs stereo rendering on the Varjo HMD."));
+		return false;
 	}
+	return m_dynamicResolutionState->StartCalibration();
+}
+
+bool FVarjoHMD::IsDynamicResolutionCalibrating() const
+{
+	return m_dynamicResolutionState.IsValid() && m_dynamicResolutionState->IsCalibrating();
 }
 
 void FVarjoHMD::SetupViewFamily(FSceneViewFamily& InViewFamily)
@@ -1093,7 +1320,10 @@ void FVarjoHMD::SetupViewFamily(FSceneViewFamily& InViewFamily)
 
 void FVarjoHMD::PostRenderViewFamily_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& InViewFamily)
 {
-	m_bridge->FinishRendering(RHICmdList);
+	if (m_bridge != nullptr)
+	{
+		m_bridge->FinishRendering(RHICmdList);
+	}
 }
 
 void FVarjoHMD::DrawHiddenAreaMesh_RenderThread(FRHICommandList& RHICmdList, EStereoscopicPass StereoPass) const
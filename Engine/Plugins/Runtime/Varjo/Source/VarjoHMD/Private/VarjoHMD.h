@@ -12,6 +12,11 @@ static const bool USE_OCCLUSION_MESH = true;
 
 #include "VarjoCustomPresentD3D11.h"
 #include "VarjoCustomPresentD3D12.h"
+#ifdef VARJO_USE_VULKAN
+#include "VarjoCustomPresentVulkan.h"
+#endif
+#include "VarjoCustomPresentNull.h"
+#include "VarjoAtlasLayout.h"
 #include "HeadMountedDisplayBase.h"
 #include "IVarjoHMDPlugin.h"
 #include "XRRenderTargetManager.h"
@@ -88,10 +93,11 @@ public:
 	virtual bool IsStereoEnabled() const override;
 	bool OnStereoTeardown();
 	bool OnStereoStartup();
+	void SetBridgeSuspended(bool suspended);
 	virtual bool EnableStereo(bool bStereo) override;
 	virtual bool IsSpectatorScreenActive() const override { return true; }
 	virtual void OnBeginRendering_RenderThread(FRHICommandListImmediate& RHICmdList, FSceneViewFamily& ViewFamily) override;
-	virtual int32 GetDesiredNumberOfViews(bool bStereoRequested) const override { if (bStereoRequested) return 4; else return 1; }
+	virtual int32 GetDesiredNumberOfViews(bool bStereoRequested) const override { if (bStereoRequested) return m_dualView ? 2 : 4; else return 1; }
 	virtual class TSharedPtr< class IXRCamera, ESPMode::ThreadSafe > GetXRCamera(int32 DeviceId) override;
 #ifdef VARJO_USE_CUSTOM_ENGINE
 	virtual bool IsISRPrimaryView(EStereoscopicPass Pass) override { return Pass == eSSP_LEFT_EYE || Pass == eSSP_LEFT_FOCUS; }
@@ -102,6 +108,7 @@ public:
 	virtual void CalculateRenderTargetSize(const FViewport& Viewport, uint32& InOutSizeX, uint32& InOutSizeY) override;
 	virtual bool NeedReAllocateViewportRenderTarget(const class FViewport& Viewport) override;
 	virtual bool NeedReAllocateDepthTexture(const TRefCountPtr<IPooledRenderTarget>& DepthTarget) override;
+	virtual uint32 GetNumberOfBufferedFrames() const override;
 	virtual bool AllocateRenderTargetTexture(uint32 Index, uint32 SizeX, uint32 SizeY, uint8 Format, uint32 NumMips, uint32 InTexFlags, uint32 InTargetableTextureFlags, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture, uint32 NumSamples = 1) override;
 	virtual bool AllocateDepthTexture(uint32 Index, uint32 SizeX, uint32 SizeY, uint8 Format, uint32 NumMips, uint32 InTexFlags, uint32 TargetableTextureFlags, FTexture2DRHIRef& OutTargetableTexture, FTexture2DRHIRef& OutShaderResourceTexture, uint32 NumSamples = 1) override;
 	virtual void UpdateViewportRHIBridge(bool bUseSeparateRenderTarget, const class FViewport& Viewport, FRHIViewport* const ViewportRHI) override;
@@ -118,6 +125,8 @@ public:
 
 	void SetHeadtrackingEnabled(bool enabled);
 	void SetDepthSubmissionEnabled(bool enabled);
+	bool StartDynamicResolutionCalibration();
+	bool IsDynamicResolutionCalibrating() const;
 
 	// VarjoHMDFunctionLibrary
 	VARJOHMD_API bool GetButtonEvent(int& button, bool& pressed) const;
@@ -135,6 +144,8 @@ public:
 
 	void CopyDepthTexture_RenderThread(FRHICommandListImmediate& RHICmdList, FTexture2DRHIRef dst, FTexture2DRHIRef src);
 
+	const FVarjoAtlasLayout& GetAtlasLayout() const { return m_atlasLayout; }
+
 	static pVRGetGenericInterface VRGetGenericInterfaceFn;
 
 	static const FName VarjoSystemName;
@@ -156,6 +167,10 @@ private:
 	FVarjoHMD();
 	bool Startup();
 	void Shutdown();
+	// Begins and submits a frame on the render thread when running on the null RHI. Game thread.
+	void RunHeadlessFrame();
+	// Hands the compositor period to the dynamic resolution controller and returns this frame's view fractions.
+	void UpdateDynamicResolution_RenderThread(VarjoCustomPresent* bridge, float& OutContextFraction, float& OutFocusFraction);
 	void PoseToOrientationAndPosition(const vr::HmdMatrix34_t& InPose, bool InFlip, FQuat& OutOrientation, FVector& OutPosition) const;
 
 	float IPD();
@@ -205,11 +220,25 @@ private:
 	FQuat m_currentOrientation_rt;
 
 	FMatrix m_currentProjections[4];
+	FVarjoAtlasLayout m_atlasLayout;
 	vr::IVRSystem* m_VRSystem;
 	FVector m_baseOffset = FVector::ZeroVector;
 	FQuat m_baseOrientation = FQuat::Identity;
 	float m_worldToMetersScale = 100.0f;
 	TSharedPtr<class FVarjoDynamicResolutionState> m_dynamicResolutionState;
+	// Stereo was turned off in warm standby: session, swap chains and targets are still alive.
+	bool m_standby = false;
+	bool m_stereoWindowApplied = false;
+	// Only the context views are rendered this game frame, as asked by dynamic resolution under heavy GPU load.
+	bool m_dualView = false;
+	uint32 m_viewModeSwitches = 0;
+	// Angular extent of the focus views this game frame, relative to the runtime's.
+	float m_focusAreaScale = 1.0f;
+	// The same scale on the render thread. Updated by a render command ahead of the game frame's view families, so
+	// the frame they begin is submitted with the rects and projections they were rendered with.
+	float m_renderFocusAreaScale = 1.0f;
+	// Map the dynamic resolution warm start is keyed by.
+	FString m_dynamicResolutionMap;
 
 	class VarjoGaze* m_gaze;
 	HMDVisiblityStatus m_HMDVisiblityStatus;
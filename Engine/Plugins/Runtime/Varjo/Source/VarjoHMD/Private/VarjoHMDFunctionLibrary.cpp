@@ -125,12 +125,29 @@ void UVarjoHMDFunctionLibrary::SetHeadtrackingEnabled(bool Enabled)
 
 void UVarjoHMDFunctionLibrary::SetDepthSubmissionEnabled(bool Enabled)
 {
-#ifdef VARJO_USE_CUSTOM_ENGINE
 	FVarjoHMD* VarjoHMD = GetVarjoHMD();
 	if (VarjoHMD)
 	{
 		VarjoHMD->SetDepthSubmissionEnabled(Enabled);
 	}
-#endif
 }
 
+bool UVarjoHMDFunctionLibrary::StartDynamicResolutionCalibration()
+{
+	FVarjoHMD* VarjoHMD = GetVarjoHMD();
+	if (VarjoHMD)
+	{
+		return VarjoHMD->StartDynamicResolutionCalibration();
+	}
+	return false;
+}
+
+bool UVarjoHMDFunctionLibrary::IsDynamicResolutionCalibrating()
+{
+	FVarjoHMD* VarjoHMD = GetVarjoHMD();
+	if (VarjoHMD)
+	{
+		return VarjoHMD->IsDynamicResolutionCalibrating();
+	}
+	return false;
+}
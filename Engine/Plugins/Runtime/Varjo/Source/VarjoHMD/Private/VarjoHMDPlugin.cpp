@@ -7,6 +7,8 @@
 FVarjoHMDPlugin::FVarjoHMDPlugin()
 	: m_varjoLibHandle(nullptr)
 	, m_openvr_apiHandle(nullptr)
+	, m_graphicsAdapterLuid(0)
+	, m_graphicsAdapterLuidQueried(false)
 {
 }
 
@@ -54,7 +56,29 @@ bool FVarjoHMDPlugin::IsHMDConnected()
 
 uint64 FVarjoHMDPlugin::GetGraphicsAdapterLuid()
 {
-	return 0;
+	if (m_graphicsAdapterLuidQueried)
+	{
+		return m_graphicsAdapterLuid;
+	}
+	m_graphicsAdapterLuidQueried = true;
+
+	if (EnsureVarjoDllLoaded() == false)
+	{
+		return 0;
+	}
+
+	// Called before the RHI exists, so use a short-lived session of our own.
+	auto session = varjo_SessionInit();
+	if (!session)
+	{
+		return 0;
+	}
+
+	m_graphicsAdapterLuid = VarjoGetCompositorAdapterLuid(session);
+	varjo_SessionShutDown(session);
+
+	UE_CLOG(m_graphicsAdapterLuid != 0, LogHMD, Log, TEXT("Varjo compositor runs on adapter LUID 0x%016llx."), m_graphicsAdapterLuid);
+	return m_graphicsAdapterLuid;
 }
 
 pVRGetGenericInterface FVarjoHMD::VRGetGenericInterfaceFn = nullptr;
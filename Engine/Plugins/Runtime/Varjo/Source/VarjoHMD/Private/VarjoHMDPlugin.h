@@ -23,4 +23,7 @@ private:
 	TSharedPtr< class FVarjoHMD, ESPMode::ThreadSafe > m_hmd;
 	void* m_varjoLibHandle;
 	void* m_openvr_apiHandle;
+	// Adapter the compositor runs on, queried once. 0 if unknown.
+	uint64 m_graphicsAdapterLuid;
+	bool m_graphicsAdapterLuidQueried;
 };
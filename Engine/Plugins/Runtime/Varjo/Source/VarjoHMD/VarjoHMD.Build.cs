@@ -74,6 +74,21 @@ namespace UnrealBuildTool.Rules
 
 				AddEngineThirdPartyPrivateStaticDependencies(Target, "DX11");
 				AddEngineThirdPartyPrivateStaticDependencies(Target, "DX12");
+
+				// The Vulkan bridge builds against VulkanRHI's private headers; engines shipped without them get
+				// the D3D bridges only.
+				if (System.IO.Directory.Exists(srcrt_path + "VulkanRHI/Private"))
+				{
+					PrivateDependencyModuleNames.Add("VulkanRHI");
+					PrivateIncludePaths.AddRange(
+						new string[]
+						{
+							srcrt_path + "VulkanRHI/Private",
+							srcrt_path + "VulkanRHI/Private/Windows",
+						});
+					AddEngineThirdPartyPrivateStaticDependencies(Target, "Vulkan");
+					PrivateDefinitions.Add("VARJO_USE_VULKAN=1");
+				}
 				AddEngineThirdPartyPrivateStaticDependencies(Target, "OpenVR");
 				AddEngineThirdPartyPrivateStaticDependencies(Target, "NVAftermath");
 				AddEngineThirdPartyPrivateStaticDependencies(Target, "IntelMetricsDiscovery");